@@ -1,21 +1,11 @@
-QT       += core gui printsupport
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++17
-
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+include(vibecad.pri)
 
 SOURCES += \
     main.cpp \
-    mainwindow.cpp \
-    canvas.cpp
+    mainwindow.cpp
 
 HEADERS += \
-    mainwindow.h \
-    canvas.h
+    mainwindow.h
 
 FORMS += \
     mainwindow.ui
@@ -0,0 +1,71 @@
+#include "asyncsceneio.h"
+#include "profiler.h"
+#include "scenejournal.h"
+
+#include <QtConcurrentRun>
+
+#include <algorithm>
+
+namespace {
+
+// The first preview; each later one is twice as large
+constexpr int firstPreviewSize = 64 * 1024;
+
+void indexShapes(const ShapeStore &shapes, SpatialIndex &index, int from)
+{
+    for (int slot = from; slot < shapes.size(); ++slot)
+        index.insert(shapes.idAt(slot), shapes.boundsAt(slot));
+}
+
+} // namespace
+
+namespace AsyncSceneIO {
+
+QFuture<LoadedScene> load(const QString &path)
+{
+    return QtConcurrent::run([path](QPromise<LoadedScene> &promise) {
+        PROFILE_SCOPE("load_async", Profiler::Metric::LoadMs);
+        LoadedScene scene;
+        scene.path = path;
+
+        // Parsing only appends slots, so previews index what is new since the
+        // last one. Each preview is a snapshot of the store; the parser's next
+        // append copies only the last chunk of each column.
+        const SceneIO::Progress report = reportTo(promise);
+        int indexed = 0;
+        int nextPreview = firstPreviewSize;
+        const auto progress = [&](qint64 done, qint64 total) {
+            if (scene.shapes.size() >= nextPreview)
+            {
+                indexShapes(scene.shapes, scene.index, indexed);
+                indexed = scene.shapes.size();
+                nextPreview = std::max(nextPreview, indexed) * 2;
+
+                LoadedScene preview;
+                preview.path = path;
+                preview.shapes = scene.shapes;
+                preview.index = scene.index;
+                promise.addResult(std::move(preview));
+            }
+            return report(done, total);
+        };
+
+        if (!SceneJournal::recover(path, scene.shapes, &scene.generation, &scene.clean, progress))
+            return;
+
+        // Journal replay may have removed shapes, so the final index is fresh
+        scene.index.clear();
+        indexShapes(scene.shapes, scene.index, 0);
+        scene.complete = true;
+        promise.addResult(std::move(scene));
+    });
+}
+
+QFuture<bool> save(const QString &path, const ShapeStore &shapes)
+{
+    return QtConcurrent::run([path, copy = shapes](QPromise<bool> &promise) {
+        promise.addResult(SceneIO::save(path, copy, SceneIO::formatForPath(path), reportTo(promise)));
+    });
+}
+
+} // namespace AsyncSceneIO
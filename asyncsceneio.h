@@ -0,0 +1,51 @@
+#ifndef ASYNCSCENEIO_H
+#define ASYNCSCENEIO_H
+
+#include <QFuture>
+#include <QPromise>
+#include <QString>
+
+#include "sceneio.h"
+#include "shapestore.h"
+#include "spatialindex.h"
+
+// Scene loading and saving on the QtConcurrent pool. Futures report progress
+// in per mille and are cancelled through QFuture::cancel().
+namespace AsyncSceneIO {
+
+// A scene ready to be swapped into a canvas: shapes plus their spatial
+// index, both built off the GUI thread
+struct LoadedScene
+{
+    QString path;
+    ShapeStore shapes;
+    SpatialIndex index;
+    quint64 generation = 0; // see SceneJournal::recover()
+    bool clean = false;
+    bool complete = false;  // false for a preview of a load still running
+};
+
+// Loads path and replays its journal. While parsing, the future receives
+// preview scenes at geometrically growing sizes, so the total preview work
+// stays linear in the scene; the last result is the complete scene. A
+// failed or cancelled load produces no complete result.
+QFuture<LoadedScene> load(const QString &path);
+
+// Saves a copy of shapes; the copy is a snapshot sharing the store's
+// chunks, so it is cheap and later edits do not disturb the save.
+QFuture<bool> save(const QString &path, const ShapeStore &shapes);
+
+// Forwards SceneIO progress to promise, and its cancellation back
+template<typename T>
+SceneIO::Progress reportTo(QPromise<T> &promise)
+{
+    promise.setProgressRange(0, 1000);
+    return [&promise](qint64 done, qint64 total) {
+        promise.setProgressValue(total > 0 ? int(done * 1000 / total) : 0);
+        return !promise.isCanceled();
+    };
+}
+
+} // namespace AsyncSceneIO
+
+#endif // ASYNCSCENEIO_H
@@ -0,0 +1,264 @@
+#include "batchrenderer.h"
+#include "pagepipeline.h"
+#include "sceneio.h"
+#include "shapestore.h"
+#include "threadpool.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QMarginsF>
+#include <QPageLayout>
+#include <QPageSize>
+#include <QPainter>
+#include <QPdfWriter>
+#include <QPicture>
+#include <QtMath>
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// A4 landscape in millimetres, which are canvas pixels under the print mapping
+constexpr int pageWidth = 297;
+constexpr int pageHeight = 210;
+
+// Room left of and below the origin, and past the furthest shape
+constexpr int axisMargin = 40;
+
+PagePipeline::Grid pageGrid(const QSize &canvasSize)
+{
+    return PagePipeline::grid(canvasSize, QSizeF(pageWidth, pageHeight));
+}
+
+// Room around each shape for pens and antialiasing, in canvas pixels
+constexpr qreal bleed = 2;
+
+QVector<QVector<ShapeId>> partitionPages(const ShapeStore &shapes, const QSize &canvasSize)
+{
+    const QPoint origin = SceneRenderer::viewOrigin(canvasSize);
+    const QTransform toCanvas(1, 0, 0, -1, origin.x(), origin.y());
+    return PagePipeline::partition(shapes, toCanvas, pageGrid(canvasSize), bleed);
+}
+
+// Shapes not wholly on a canvas of canvasSize. The canvas shows world x
+// from -axisMargin on and world y up to axisMargin below the origin, and a
+// box covers one unit past its max corner.
+qint64 shapesOffCanvas(const ShapeStore &shapes, const QSize &canvasSize)
+{
+    const QPoint origin = SceneRenderer::viewOrigin(canvasSize);
+    const qint64 left = -origin.x();
+    const qint64 right = left + canvasSize.width();
+    const qint64 bottom = origin.y() - canvasSize.height();
+    const qint64 top = origin.y();
+    qint64 count = 0;
+    for (int run = 0; run < shapes.runCount(); ++run)
+    {
+        const GeometryKernels::Boxes boxes = shapes.boxRun(run);
+        for (int i = 0; i < boxes.count; ++i)
+        {
+            if (boxes.minX[i] < left || qint64(boxes.maxX[i]) + 1 > right || boxes.minY[i] < bottom
+                || qint64(boxes.maxY[i]) + 1 > top)
+                ++count;
+        }
+    }
+    return count;
+}
+
+bool writePdf(const QString &path, const ShapeStore &shapes, const QSize &canvasSize,
+              const BatchRenderer::Options &options, int &pages)
+{
+    QPdfWriter writer(path);
+    writer.setCreator("VibeCad");
+    writer.setResolution(options.dpi);
+    writer.setPageSize(QPageSize(QPageSize::A4));
+    writer.setPageOrientation(QPageLayout::Landscape);
+    writer.setPageMargins(QMarginsF(0, 0, 0, 0));
+
+    QPainter painter;
+    if (!painter.begin(&writer))
+        return false;
+
+    // Pages are recorded in parallel and replayed into the writer in order;
+    // the writer encodes them during the replay, serially
+    const PagePipeline::Grid grid = pageGrid(canvasSize);
+    const QVector<QVector<ShapeId>> shapesOnPage = partitionPages(shapes, canvasSize);
+    const qreal scale = writer.resolution() / 25.4; // device units per mm
+    const bool ok = PagePipeline::recordPictures(
+        grid.count(),
+        [&](int page, QPainter &pagePainter) {
+            pagePainter.scale(scale, scale);
+            BatchRenderer::paintPage(pagePainter, shapes, shapesOnPage.at(page), canvasSize, page % grid.cols,
+                                     page / grid.cols, options.lod);
+        },
+        [&](int page, const QPicture &picture) {
+            if (page > 0 && !writer.newPage())
+                return false;
+            painter.drawPicture(0, 0, picture);
+            return true;
+        });
+    pages = grid.count();
+    return painter.end() && ok;
+}
+
+bool writePng(const QString &basePath, const ShapeStore &shapes, const QSize &canvasSize,
+              const BatchRenderer::Options &options, int &pages)
+{
+    const QSize pixels = BatchRenderer::pagePixels(options.dpi);
+    const PagePipeline::Grid grid = pageGrid(canvasSize);
+    const QVector<QVector<ShapeId>> shapesOnPage = partitionPages(shapes, canvasSize);
+    pages = grid.count();
+    return PagePipeline::renderImages(
+        grid.count(), pixels,
+        [&](int page, QPainter &painter) {
+            painter.scale(pixels.width() / qreal(pageWidth), pixels.height() / qreal(pageHeight));
+            BatchRenderer::paintPage(painter, shapes, shapesOnPage.at(page), canvasSize, page % grid.cols,
+                                     page / grid.cols, options.lod);
+        },
+        [&](int page, QImage image) {
+            image.setDotsPerMeterX(qRound(options.dpi / 0.0254));
+            image.setDotsPerMeterY(qRound(options.dpi / 0.0254));
+            const QString path = grid.count() == 1 ? basePath + ".png"
+                                                   : QString("%1-%2.png").arg(basePath).arg(page + 1);
+            return image.save(path, "PNG");
+        });
+}
+
+} // namespace
+
+namespace BatchRenderer {
+
+Stats run(const QStringList &inputs, const Options &options, QStringList *errors)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!options.outputDir.isEmpty())
+        QDir().mkpath(options.outputDir);
+
+    // Results are written through raw pointers taken before the workers start,
+    // so no task ever detaches a shared container
+    const int count = int(inputs.size());
+    QVector<Stats> results(count);
+    QVector<QString> messages(count);
+    Stats *resultData = results.data();
+    QString *messageData = messages.data();
+
+    QVector<std::function<void()>> tasks;
+    tasks.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        tasks.append([&, i] {
+            if (!renderFile(inputs.at(i), options, resultData[i], &messageData[i]))
+                resultData[i].failed = 1;
+        });
+    }
+    WorkStealingPool::global().run(tasks);
+
+    Stats total;
+    total.files = count;
+    for (int i = 0; i < count; ++i)
+    {
+        total.failed += results.at(i).failed;
+        total.pages += results.at(i).pages;
+        total.shapes += results.at(i).shapes;
+        total.clipped += results.at(i).clipped;
+        if (errors && !messages.at(i).isEmpty())
+            errors->append(messages.at(i));
+    }
+    total.elapsedMs = timer.elapsed();
+    return total;
+}
+
+bool renderFile(const QString &input, const Options &options, Stats &stats, QString *error)
+{
+    ShapeStore shapes;
+    if (!SceneIO::load(input, shapes))
+    {
+        if (error)
+            *error = QString("%1: could not load scene").arg(input);
+        return false;
+    }
+
+    const QSize canvasSize = options.canvasSize.isEmpty() ? fittingCanvasSize(shapes) : options.canvasSize;
+    const PagePipeline::Grid grid = pageGrid(canvasSize);
+    const qint64 pageCount = qint64(grid.cols) * grid.rows;
+    if (pageCount > options.maxPages)
+    {
+        if (error)
+            *error = QString("%1: needs %2 pages for a %3 x %4 mm canvas, more than the limit of %5")
+                         .arg(input)
+                         .arg(pageCount)
+                         .arg(canvasSize.width())
+                         .arg(canvasSize.height())
+                         .arg(options.maxPages);
+        return false;
+    }
+
+    const QFileInfo info(input);
+    const QString dir = options.outputDir.isEmpty() ? info.absolutePath() : options.outputDir;
+    const QString basePath = QDir(dir).filePath(info.completeBaseName());
+
+    int pages = 0;
+    const bool ok = options.format == Format::Pdf
+                        ? writePdf(basePath + ".pdf", shapes, canvasSize, options, pages)
+                        : writePng(basePath, shapes, canvasSize, options, pages);
+    if (!ok)
+    {
+        if (error)
+            *error = QString("%1: could not write output to %2").arg(input, dir);
+        return false;
+    }
+
+    stats.pages += pages;
+    stats.shapes += shapes.size();
+    const qint64 clipped = shapesOffCanvas(shapes, canvasSize);
+    stats.clipped += clipped;
+    if (clipped > 0 && error)
+        *error = QString("%1: %2 shapes lie partly or wholly off the canvas and are cut off").arg(input).arg(clipped);
+    return true;
+}
+
+QSize fittingCanvasSize(const ShapeStore &shapes)
+{
+    qint64 right = pageWidth;
+    qint64 top = pageHeight;
+    if (!shapes.isEmpty())
+    {
+        const QRect extent = shapes.extent();
+        right = std::max(right, qint64(extent.right()) + 1);
+        top = std::max(top, qint64(extent.bottom()) + 1);
+    }
+    return QSize(int(std::min<qint64>(axisMargin + right + axisMargin, maxCanvasLength)),
+                 int(std::min<qint64>(axisMargin + top + axisMargin, maxCanvasLength)));
+}
+
+QSize pagePixels(int dpi)
+{
+    return QSize(qRound(pageWidth * dpi / 25.4), qRound(pageHeight * dpi / 25.4));
+}
+
+void paintPage(QPainter &painter, const ShapeStore &shapes, const QVector<ShapeId> &ids,
+               const QSize &canvasSize, int col, int row, const SceneRenderer::LodSettings &lod)
+{
+    const QRect view(QPoint(0, 0), canvasSize);
+    const QRect page(col * pageWidth, row * pageHeight, pageWidth, pageHeight);
+    const QRect area = page.intersected(view);
+    if (area.isEmpty())
+        return;
+
+    painter.save();
+    painter.translate(-page.topLeft());
+    painter.setClipRect(area);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+
+    const QPoint origin = SceneRenderer::viewOrigin(canvasSize);
+    SceneRenderer::drawBackground(painter, view, origin);
+    SceneRenderer::drawShapes(painter, shapes, ids, origin, lod);
+    SceneRenderer::drawAxes(painter, view, origin);
+    painter.restore();
+}
+
+} // namespace BatchRenderer
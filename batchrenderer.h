@@ -0,0 +1,77 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+#include "scenerenderer.h"
+
+class ShapeStore;
+
+// Renders scene files without a widget, using the print mapping: one canvas
+// pixel is one millimetre on an A4 landscape page, and a canvas larger than
+// a page is split over several pages, row by row. Pages go through the
+// PagePipeline: each draws only its own shapes, and pages render in parallel.
+namespace BatchRenderer {
+
+enum class Format
+{
+    Png,
+    Pdf
+};
+
+struct Options
+{
+    QString outputDir;  // empty: write next to each input file
+    Format format = Format::Png;
+    int dpi = 300;
+    QSize canvasSize;   // empty: fit the A4 sheet and every shape
+    int maxPages = 1000; // files needing more pages fail
+    SceneRenderer::LodSettings lod;
+};
+
+struct Stats
+{
+    int files = 0;
+    int failed = 0;
+    int pages = 0;
+    qint64 shapes = 0;
+    qint64 clipped = 0; // shapes lying partly or wholly off the canvas
+    qint64 elapsedMs = 0;
+};
+
+// Renders every input on the shared worker pool, one file per task; the
+// files' pages share the PagePipeline page budget, so memory stays bounded
+// however many files run at once. Error messages for failed files, and
+// warnings for files with shapes off the canvas, are appended to errors in
+// input order.
+Stats run(const QStringList &inputs, const Options &options, QStringList *errors = nullptr);
+
+// Loads, renders and writes a single scene. PNG output gets one image per
+// page, numbered from 1 when there is more than one; PDF output is one file.
+// A scene that needs more than options.maxPages pages fails without output.
+// Shapes the canvas does not show, such as those left of or below the axis
+// margins, are counted in stats.clipped and reported in error, which is
+// then set although the file rendered.
+bool renderFile(const QString &input, const Options &options, Stats &stats, QString *error = nullptr);
+
+// Canvas size that shows the A4 sheet and every shape in the positive
+// quadrant with the widget's axis margins. Each side is capped at
+// maxCanvasLength, which keeps the size from overflowing for far-flung
+// shapes; renderFile() turns such a size into too many pages.
+QSize fittingCanvasSize(const ShapeStore &shapes);
+constexpr int maxCanvasLength = 1 << 30;
+
+// Pixel size of one A4 landscape page at dpi
+QSize pagePixels(int dpi);
+
+// Paints page (col, row) of a canvas of canvasSize, drawing exactly the
+// shapes in ids (z-order), as partitioned by the page pipeline. The painter
+// is expected to map one logical unit to one millimetre of the page.
+void paintPage(QPainter &painter, const ShapeStore &shapes, const QVector<ShapeId> &ids,
+               const QSize &canvasSize, int col, int row, const SceneRenderer::LodSettings &lod);
+
+} // namespace BatchRenderer
+
+#endif // BATCHRENDERER_H
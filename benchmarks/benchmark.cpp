@@ -0,0 +1,657 @@
+#include "benchmark.h"
+#include "batchrenderer.h"
+#include "canvas.h"
+#include "geometrykernels.h"
+#include "geometryquery.h"
+#include "pagepipeline.h"
+#include "sceneio.h"
+#include "scenegenerator.h"
+#include "scenerenderer.h"
+#include "shapestore.h"
+#include "spatialindex.h"
+#include "threadpool.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMarginsF>
+#include <QMouseEvent>
+#include <QPageLayout>
+#include <QPageSize>
+#include <QPainter>
+#include <QPdfWriter>
+#include <QPicture>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct Result
+{
+    QString name;
+    QString variant;
+    int shapes = 0;
+    int ops = 1; // operations timed per sample
+    QVector<double> samples; // milliseconds
+};
+
+class Recorder
+{
+public:
+    explicit Recorder(int repeat) : repeat(std::max(1, repeat)) {}
+
+    // step(iteration) does one sample's work and returns its time in ms
+    void measure(const QString &name, const QString &variant, int shapes, int ops,
+                 const std::function<double(int)> &step)
+    {
+        Result result;
+        result.name = name;
+        result.variant = variant;
+        result.shapes = shapes;
+        result.ops = ops;
+        for (int i = 0; i < repeat; ++i)
+            result.samples.append(step(i));
+        print(result);
+        results.append(result);
+    }
+
+    // A peak resident set size in KB, from a process that did only one load:
+    // startKb before it, peakKb after
+    void recordMemory(const QString &name, const QString &variant, int shapes, qint64 startKb, qint64 peakKb)
+    {
+        QTextStream(stdout) << QString("%1 %2 %3 shapes: peak RSS %4 MB, %5 MB over the %6 MB at start\n")
+                                   .arg(name, -12)
+                                   .arg(variant, -5)
+                                   .arg(shapes, 9)
+                                   .arg(peakKb / 1024.0, 0, 'f', 1)
+                                   .arg((peakKb - startKb) / 1024.0, 0, 'f', 1)
+                                   .arg(startKb / 1024.0, 0, 'f', 1);
+
+        QJsonObject object;
+        object["name"] = name;
+        object["variant"] = variant;
+        object["shapes"] = shapes;
+        object["start_rss_mb"] = startKb / 1024.0;
+        object["peak_rss_mb"] = peakKb / 1024.0;
+        memory.append(object);
+    }
+
+    QJsonArray toJson() const
+    {
+        QJsonArray array = memory;
+        for (const Result &result : results)
+        {
+            QVector<double> sorted = result.samples;
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0;
+            for (double sample : sorted)
+                sum += sample;
+
+            QJsonObject object;
+            object["name"] = result.name;
+            object["variant"] = result.variant;
+            object["shapes"] = result.shapes;
+            object["ops"] = result.ops;
+            object["iterations"] = int(sorted.size());
+            object["min_ms"] = sorted.first();
+            object["median_ms"] = sorted.at(sorted.size() / 2);
+            object["mean_ms"] = sum / sorted.size();
+            object["max_ms"] = sorted.last();
+            array.append(object);
+        }
+        return array;
+    }
+
+    const int repeat;
+
+private:
+    void print(const Result &result) const
+    {
+        QVector<double> sorted = result.samples;
+        std::sort(sorted.begin(), sorted.end());
+        QTextStream out(stdout);
+        out << QString("%1 %2 %3 shapes: median %4 ms, min %5 ms")
+                   .arg(result.name, -12)
+                   .arg(result.variant, -5)
+                   .arg(result.shapes, 9)
+                   .arg(sorted.at(sorted.size() / 2), 0, 'f', 3)
+                   .arg(sorted.first(), 0, 'f', 3);
+        if (result.ops > 1)
+            out << QString(" (%1 ops)").arg(result.ops);
+        out << "\n";
+    }
+
+    QVector<Result> results;
+    QJsonArray memory;
+};
+
+template <typename F>
+double timed(F f)
+{
+    QElapsedTimer timer;
+    timer.start();
+    f();
+    return timer.nsecsElapsed() / 1e6;
+}
+
+void click(Canvas &canvas, const QPoint &world)
+{
+    const QPointF pos = canvas.viewTransform().map(QPointF(world));
+    QMouseEvent press(QEvent::MouseButtonPress, pos, pos, Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+    QCoreApplication::sendEvent(&canvas, &press);
+}
+
+// Times each geometry kernel with every instruction set this CPU has and
+// checks the vector results against the scalar ones
+bool benchmarkKernels(Recorder &recorder, const ShapeStore &shapes, int side)
+{
+    using namespace GeometryKernels;
+
+    // The store keeps its columns in runs; one contiguous copy times the
+    // kernels on the whole scene at once
+    const int count = shapes.size();
+    QVector<qint32> minX(count), minY(count), maxX(count), maxY(count);
+    for (int slot = 0; slot < count; ++slot)
+    {
+        minX[slot] = shapes.minXAt(slot);
+        minY[slot] = shapes.minYAt(slot);
+        maxX[slot] = shapes.maxXAt(slot);
+        maxY[slot] = shapes.maxYAt(slot);
+    }
+    Boxes boxes;
+    boxes.minX = minX.constData();
+    boxes.minY = minY.constData();
+    boxes.maxX = maxX.constData();
+    boxes.maxY = maxY.constData();
+    boxes.count = count;
+
+    // Every point query scans all shapes, so fewer points than hit_test
+    const int points = std::min(100, count);
+    const int stride = std::max(1, count / std::max(1, points));
+    const QRect quarter(side / 4, side / 4, side / 2, side / 2);
+
+    QVector<int> found(count);
+    QVector<double> outX(count), outY(count);
+    QRect united;
+    QVector<int> containingHits, intersectingHits, circleHits;
+    const auto run = [&](const QString &variant) {
+        recorder.measure("kernel_unite", variant, count, 1, [&](int) {
+            return timed([&] { united = unite(boxes); });
+        });
+        recorder.measure("kernel_transform", variant, count, 1, [&](int) {
+            return timed([&] {
+                transform(boxes.minX, boxes.minY, count, 0.25, 600, -0.25, 400, outX.data(), outY.data());
+            });
+        });
+        recorder.measure("kernel_containing", variant, count, points, [&](int) {
+            containingHits.clear();
+            double ms = 0;
+            for (int i = 0; i < points; ++i)
+            {
+                const QPoint point = shapes.centerAt((i * stride) % count);
+                int n = 0;
+                ms += timed([&] { n = containing(boxes, point, found.data()); });
+                containingHits.append(found.mid(0, n));
+            }
+            return ms;
+        });
+        recorder.measure("kernel_intersecting", variant, count, 1, [&](int) {
+            int n = 0;
+            const double ms = timed([&] { n = intersecting(boxes, quarter, found.data()); });
+            intersectingHits = found.mid(0, n);
+            return ms;
+        });
+        recorder.measure("kernel_circles", variant, count, points, [&](int) {
+            circleHits.clear();
+            double ms = 0;
+            for (int i = 0; i < points; ++i)
+            {
+                const QPoint point = shapes.centerAt((i * stride) % count);
+                int n = 0;
+                ms += timed([&] { n = circlesContaining(boxes, point, found.data()); });
+                circleHits.append(found.mid(0, n));
+            }
+            return ms;
+        });
+    };
+
+    setActiveIsa(Isa::Scalar);
+    run(isaName(Isa::Scalar));
+    const QRect scalarUnited = united;
+    const QVector<double> scalarX = outX, scalarY = outY;
+    const QVector<int> scalarContaining = containingHits;
+    const QVector<int> scalarIntersecting = intersectingHits;
+    const QVector<int> scalarCircles = circleHits;
+
+    bool ok = true;
+    const auto close = [](double a, double b) { return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(a)); };
+    for (int isa = int(Isa::Scalar) + 1; isa <= int(bestIsa()); ++isa)
+    {
+        setActiveIsa(Isa(isa));
+        run(isaName(Isa(isa)));
+
+        bool same = united == scalarUnited && containingHits == scalarContaining
+                    && intersectingHits == scalarIntersecting && circleHits == scalarCircles;
+        for (int i = 0; same && i < count; ++i)
+            same = close(outX.at(i), scalarX.at(i)) && close(outY.at(i), scalarY.at(i));
+        if (!same)
+        {
+            QTextStream(stderr) << isaName(Isa(isa)) << " kernels disagree with the scalar ones\n";
+            ok = false;
+        }
+    }
+    setActiveIsa(bestIsa());
+    return ok;
+}
+
+// JSON loading as it was before the streaming parser: the whole file read
+// into memory, parsed into a QJsonDocument and copied out of the DOM
+bool loadJsonDom(const QString &path, ShapeStore &shapes)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    if (!doc.isObject())
+        return false;
+
+    shapes.clear();
+    const QJsonObject root = doc.object();
+    for (const QJsonValue &v : root.value("rectangles").toArray())
+    {
+        const QJsonObject o = v.toObject();
+        shapes.addRectangle(QRect(QPoint(o.value("bl_x").toInt(), o.value("bl_y").toInt()),
+                                  QPoint(o.value("tr_x").toInt(), o.value("tr_y").toInt())));
+    }
+    for (const QJsonValue &v : root.value("circles").toArray())
+    {
+        const QJsonObject o = v.toObject();
+        const int r = o.value("r").toInt();
+        if (r > 0)
+            shapes.addCircle(QPoint(o.value("cx").toInt(), o.value("cy").toInt()), r);
+    }
+    return true;
+}
+
+// Peak resident set size of this process so far, in KB
+qint64 peakRssKb()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return qint64(counters.PeakWorkingSetSize / 1024);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss / 1024; // bytes there
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Runs Benchmark::loadOnce() in a fresh process, since a process's peak
+// never goes down, and records what it reports. variant is "dom" for the
+// QJsonDocument path, empty for the streaming parser.
+bool measurePeakRss(Recorder &recorder, const QString &variant, const QString &path, int shapes)
+{
+    QProcess child;
+    child.start(QCoreApplication::applicationFilePath(), {"--peak-rss", variant.isEmpty() ? "stream" : variant, path});
+    if (!child.waitForFinished(-1) || child.exitStatus() != QProcess::NormalExit || child.exitCode() != 0)
+        return false;
+
+    const QStringList fields = QString::fromLatin1(child.readAllStandardOutput()).split(' ', Qt::SkipEmptyParts);
+    bool okStart = false, okPeak = false;
+    const qint64 startKb = fields.value(0).toLongLong(&okStart);
+    const qint64 peakKb = fields.value(1).toLongLong(&okPeak);
+    if (!okStart || !okPeak || startKb < 0 || peakKb < 0)
+        return false;
+    recorder.recordMemory("load_json", variant, shapes, startKb, peakKb);
+    return true;
+}
+
+// Times the clash report and snapping, and checks the report against
+// testing every pair, or for large scenes every pair with one of a sample of
+// shapes, whose partners come from the spatial index
+bool benchmarkQueries(Recorder &recorder, const ShapeStore &shapes, const SpatialIndex &index, int side)
+{
+    const int count = shapes.size();
+    QVector<GeometryQuery::Overlap> pairs;
+    recorder.measure("overlaps", "", count, 1, [&](int) {
+        return timed([&] { pairs = GeometryQuery::overlaps(shapes); });
+    });
+
+    bool ok = true;
+    QVector<GeometryQuery::Overlap> expected;
+    if (count <= 10000)
+    {
+        for (int a = 0; a < count; ++a)
+        {
+            for (int b = a + 1; b < count; ++b)
+            {
+                if (GeometryQuery::overlap(shapes, a, b))
+                {
+                    const ShapeId idA = shapes.idAt(a);
+                    const ShapeId idB = shapes.idAt(b);
+                    expected.append(GeometryQuery::Overlap{std::min(idA, idB), std::max(idA, idB)});
+                }
+            }
+        }
+    }
+    else
+    {
+        const int samples = 1000;
+        QVector<ShapeId> sampled;
+        QVector<quint32> candidates;
+        for (int i = 0; i < samples; ++i)
+        {
+            const int a = int(qint64(i) * count / samples);
+            const ShapeId idA = shapes.idAt(a);
+            sampled.append(idA);
+            index.query(shapes.boundsAt(a), candidates);
+            for (quint32 idB : candidates)
+            {
+                const int b = shapes.slotOf(idB);
+                if (b != a && GeometryQuery::overlap(shapes, a, b))
+                    expected.append(GeometryQuery::Overlap{std::min(idA, idB), std::max(idA, idB)});
+            }
+        }
+        std::sort(sampled.begin(), sampled.end());
+        const auto isSampled = [&](ShapeId id) { return std::binary_search(sampled.begin(), sampled.end(), id); };
+        pairs.erase(std::remove_if(pairs.begin(), pairs.end(),
+                                   [&](const GeometryQuery::Overlap &pair) {
+                                       return !isSampled(pair.a) && !isSampled(pair.b);
+                                   }),
+                    pairs.end());
+    }
+    // A pair of two sampled shapes comes up from both
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    if (pairs != expected)
+    {
+        QTextStream(stderr) << "overlaps found " << pairs.size() << " pairs, testing pair by pair "
+                            << expected.size() << "\n";
+        ok = false;
+    }
+
+    // Snapping from points spread over the scene, 8 units around each
+    const int snaps = 1000;
+    recorder.measure("snap", "", count, snaps, [&](int) {
+        return timed([&] {
+            for (int i = 0; i < snaps; ++i)
+                GeometryQuery::snapPoint(shapes, index, QPointF(i * 7919 % side, i * 104729 % side), 8);
+        });
+    });
+    return ok;
+}
+
+// drawShapes() with the whole scene in one 1200 x 800 frame, once with each
+// style drawn as one batch and once in exact z-order, where the generated
+// scene's alternating rectangles and circles leave runs of one shape
+void benchmarkDraw(Recorder &recorder, const ShapeStore &shapes, int side)
+{
+    QVector<ShapeId> ids;
+    ids.reserve(shapes.size());
+    shapes.forEachInZOrder([&](int slot) { ids.append(shapes.idAt(slot)); });
+
+    QImage frame(1200, 800, QImage::Format_ARGB32_Premultiplied);
+    const qreal scale = qreal(frame.height()) / side;
+    for (bool grouped : {true, false})
+    {
+        SceneRenderer::LodSettings lod;
+        lod.groupStyles = grouped;
+        recorder.measure("draw", grouped ? "group" : "exact", shapes.size(), 1, [&](int) {
+            frame.fill(Qt::white);
+            QPainter painter(&frame);
+            painter.setRenderHint(QPainter::Antialiasing, true);
+            painter.scale(scale, scale);
+            return timed([&] { SceneRenderer::drawShapes(painter, shapes, ids, QPoint(0, side), lod); });
+        });
+    }
+}
+
+bool benchmarkSize(Recorder &recorder, int count, const QDir &dir)
+{
+    bool ok = true;
+    ShapeStore generated;
+    const int side = SceneGenerator::sideForCount(count);
+    recorder.measure("generate", "", count, 1, [&](int) {
+        return timed([&] {
+            generated.clear();
+            SceneGenerator::generate(generated, count, side);
+        });
+    });
+    ok &= benchmarkKernels(recorder, generated, side);
+
+    SpatialIndex index;
+    for (int slot = 0; slot < generated.size(); ++slot)
+        index.insert(generated.idAt(slot), generated.boundsAt(slot));
+    ok &= benchmarkQueries(recorder, generated, index, side);
+    benchmarkDraw(recorder, generated, side);
+
+    const QString vcbPath = dir.filePath(QString("bench-%1.vcb").arg(count));
+    const QString jsonPath = dir.filePath(QString("bench-%1.json").arg(count));
+    if (!SceneIO::save(vcbPath, generated))
+        return false;
+
+    // Load and save through the widget, as the application does
+    Canvas canvas;
+    canvas.resize(1200, 800);
+    recorder.measure("load", "vcb", count, 1, [&](int) {
+        return timed([&] { ok &= canvas.loadFromFile(vcbPath); });
+    });
+    recorder.measure("save", "vcb", count, 1, [&](int) {
+        return timed([&] { ok &= canvas.saveToFile(vcbPath); });
+    });
+    recorder.measure("save", "json", count, 1, [&](int) {
+        return timed([&] { ok &= canvas.saveToFile(jsonPath); });
+    });
+    recorder.measure("load", "json", count, 1, [&](int) {
+        return timed([&] { ok &= canvas.loadFromFile(jsonPath); });
+    });
+
+    // The streaming JSON parser against the QJsonDocument path it replaced,
+    // both into a bare store: time here, peak memory in a fresh process each
+    ShapeStore loaded;
+    recorder.measure("load_json", "dom", count, 1, [&](int) {
+        return timed([&] { ok &= loadJsonDom(jsonPath, loaded); });
+    });
+    recorder.measure("load_json", "", count, 1, [&](int) {
+        return timed([&] { ok &= SceneIO::loadJson(jsonPath, loaded); });
+    });
+    loaded.clear();
+    ok &= measurePeakRss(recorder, "dom", jsonPath, count);
+    ok &= measurePeakRss(recorder, "", jsonPath, count);
+
+    // Frame time: cold rasterizes every visible tile, warm only composites
+    QImage frame(canvas.size(), QImage::Format_ARGB32_Premultiplied);
+    recorder.measure("paint", "cold", count, 1, [&](int) {
+        canvas.setLodSettings(canvas.lodSettings()); // drops the tile cache
+        return timed([&] { canvas.render(&frame); });
+    });
+    recorder.measure("paint", "warm", count, 1, [&](int) {
+        return timed([&] { canvas.render(&frame); });
+    });
+
+    // Panning only moves cached tiles, apart from the strip scrolled in
+    recorder.measure("paint", "pan", count, 1, [&](int) {
+        canvas.panBy(QPoint(-37, 0));
+        return timed([&] { canvas.render(&frame); });
+    });
+    canvas.resetView();
+
+    // Clicks land on shape centres spread over the whole scene
+    const int clicks = std::min(1000, count);
+    const int stride = std::max(1, count / clicks);
+    recorder.measure("hit_test", "", count, clicks, [&](int) {
+        return timed([&] {
+            for (int i = 0; i < clicks; ++i)
+                click(canvas, generated.centerAt((i * stride) % count));
+        });
+    });
+
+    // Box selection over the lower-left quarter of the scene
+    recorder.measure("select_box", "", count, 1, [&](int) {
+        return timed([&] { canvas.selectInRect(QRect(0, 0, side / 2, side / 2)); });
+    });
+
+    // Print: every page of the widget on A4 landscape at 300 dpi, through
+    // the page pipeline as MainWindow::printCanvas() drives it. "pdf" goes
+    // end to end into a PDF file, including the serial encoding in
+    // drawPicture(); "picture" is only the parallel recording it starts with;
+    // "png" rasterizes the pages as PNG export and a printer do.
+    const QSize pagePixels = BatchRenderer::pagePixels(300);
+    const QSizeF pageSize(297, 210); // one widget pixel per millimetre
+    const qreal pageScale = pagePixels.width() / pageSize.width();
+    const PagePipeline::Grid grid = PagePipeline::grid(canvas.size(), pageSize);
+    const QRectF canvasRect(canvas.rect());
+    QVector<QVector<ShapeId>> shapesOnPage;
+    const PagePipeline::PaintFunction paintPage = [&](int page, QPainter &painter) {
+        painter.scale(pageScale, pageScale);
+        painter.translate(-grid.pageRect(page).topLeft());
+        painter.setClipRect(grid.pageRect(page).intersected(canvasRect));
+        canvas.renderScene(painter, shapesOnPage.at(page));
+    };
+    const QString pdfPath = dir.filePath(QString("bench-%1.pdf").arg(count));
+    recorder.measure("print", "pdf", count, grid.count(), [&](int) {
+        return timed([&] {
+            QPdfWriter writer(pdfPath);
+            writer.setResolution(300);
+            writer.setPageSize(QPageSize(QPageSize::A4));
+            writer.setPageOrientation(QPageLayout::Landscape);
+            writer.setPageMargins(QMarginsF(0, 0, 0, 0));
+            QPainter painter;
+            if (!painter.begin(&writer))
+            {
+                ok = false;
+                return;
+            }
+            shapesOnPage = canvas.partitionPages(grid);
+            ok &= PagePipeline::recordPictures(grid.count(), paintPage, [&](int page, const QPicture &picture) {
+                if (page > 0 && !writer.newPage())
+                    return false;
+                painter.drawPicture(0, 0, picture);
+                return true;
+            });
+            ok &= painter.end();
+        });
+    });
+    QFile::remove(pdfPath);
+    recorder.measure("print", "picture", count, grid.count(), [&](int) {
+        return timed([&] {
+            shapesOnPage = canvas.partitionPages(grid);
+            ok &= PagePipeline::recordPictures(grid.count(), paintPage,
+                                               [](int, const QPicture &picture) { return !picture.isNull(); });
+        });
+    });
+    recorder.measure("print", "png", count, grid.count(), [&](int) {
+        return timed([&] {
+            shapesOnPage = canvas.partitionPages(grid);
+            ok &= PagePipeline::renderImages(grid.count(), pagePixels, paintPage,
+                                             [](int, const QImage &image) { return !image.isNull(); });
+        });
+    });
+
+    // Delete last, since it changes the scene; only deleteSelected is timed
+    const int deletes = std::min(100, count / std::max(1, recorder.repeat));
+    recorder.measure("delete", "", count, deletes, [&](int iteration) {
+        double ms = 0;
+        for (int i = 0; i < deletes; ++i)
+        {
+            click(canvas, generated.centerAt(((iteration * deletes + i) * stride) % count));
+            ms += timed([&] { canvas.deleteSelected(); });
+        }
+        return ms;
+    });
+
+    // Batched delete: each sample boxes a fresh horizontal strip; together
+    // the strips cover a tenth of the scene
+    const int strip = std::max(1, side / (10 * recorder.repeat));
+    recorder.measure("delete", "box", count, 1, [&](int iteration) {
+        canvas.selectInRect(QRect(0, iteration * strip, side, strip));
+        return timed([&] { canvas.deleteSelected(); });
+    });
+
+    QFile::remove(vcbPath);
+    QFile::remove(jsonPath);
+    return ok;
+}
+
+} // namespace
+
+namespace Benchmark {
+
+int run(const Options &options)
+{
+    QTemporaryDir temporary;
+    const QDir dir(options.workDir.isEmpty() ? temporary.path() : options.workDir);
+    if (!options.workDir.isEmpty())
+        dir.mkpath(".");
+
+    Recorder recorder(options.repeat);
+    bool ok = true;
+    for (int count : options.sizes)
+    {
+        if (count <= 0)
+            continue;
+        if (!benchmarkSize(recorder, count, dir))
+        {
+            QTextStream(stderr) << "Benchmark failed for " << count << " shapes\n";
+            ok = false;
+        }
+    }
+
+    if (!options.outputPath.isEmpty())
+    {
+        QJsonObject root;
+        root["schema"] = 1;
+        root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+        root["qt_version"] = QString(qVersion());
+        root["threads"] = WorkStealingPool::global().threadCount() + 1;
+        root["repeat"] = recorder.repeat;
+        root["results"] = recorder.toJson();
+
+        QFile file(options.outputPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            QTextStream(stderr) << "Could not write " << options.outputPath << "\n";
+            return 1;
+        }
+        file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+    }
+    return ok ? 0 : 1;
+}
+
+int loadOnce(const QString &variant, const QString &path)
+{
+    const qint64 startKb = peakRssKb();
+    ShapeStore shapes;
+    const bool ok = variant == "dom" ? loadJsonDom(path, shapes) : SceneIO::loadJson(path, shapes);
+    const qint64 peakKb = peakRssKb();
+    QTextStream(stdout) << startKb << " " << peakKb << "\n";
+    return ok ? 0 : 1;
+}
+
+} // namespace Benchmark
@@ -0,0 +1,36 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+// Times the canvas hot paths on synthetic scenes: load and save in both
+// formats, drawing the whole scene with and without style batching,
+// painting into an offscreen image with cold and warm tile caches,
+// hit-testing clicks, the clash report and snapping, deleting the selection
+// and printing every page through the page pipeline, into a PDF file and
+// into page images.
+// Needs a QApplication, since it drives a real Canvas widget.
+namespace Benchmark {
+
+struct Options
+{
+    // The 10M scene takes a few GB of memory and of scratch files
+    QVector<int> sizes{1000, 10000, 100000, 1000000, 10000000};
+    int repeat = 5;
+    QString outputPath; // JSON results; empty: only the summary on stdout
+    QString workDir;    // scratch scene files; empty: a temporary directory
+};
+
+// Returns a process exit code: non-zero if any step failed.
+int run(const Options &options);
+
+// Loads the JSON scene at path once, through QJsonDocument for variant
+// "dom" and the streaming parser otherwise, and prints the process's peak
+// resident set size in KB before and after. run() starts a fresh process
+// for each of these, with --peak-rss variant path.
+int loadOnce(const QString &variant, const QString &path);
+
+} // namespace Benchmark
+
+#endif // BENCHMARK_H
@@ -0,0 +1,20 @@
+# The benchmark suite as its own executable, built from the same sources as
+# the application: qmake benchmarks/benchmarks.pro && make, then run
+# ./vibecad-benchmarks --help for the options.
+
+include(../vibecad.pri)
+
+TEMPLATE = app
+TARGET = vibecad-benchmarks
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += \
+    main.cpp \
+    benchmark.cpp
+
+HEADERS += \
+    benchmark.h
+
+# Peak memory of the load benchmarks
+win32: LIBS += -lpsapi
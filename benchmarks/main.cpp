@@ -0,0 +1,59 @@
+#include "benchmark.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QStringList>
+
+// vibecad-benchmarks [--sizes 1000,10000] [--repeat N] [--output results.json]
+int main(int argc, char *argv[])
+{
+    // A single load, started by the suite to measure its peak memory alone
+    if (argc == 4 && qstrcmp(argv[1], "--peak-rss") == 0)
+    {
+        QCoreApplication a(argc, argv);
+        return Benchmark::loadOnce(QString::fromLocal8Bit(argv[2]), QString::fromLocal8Bit(argv[3]));
+    }
+
+    // No display needed unless the caller picked a platform explicitly
+    bool platformGiven = !qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM");
+    for (int i = 1; i < argc; ++i)
+        platformGiven = platformGiven || qstrcmp(argv[i], "-platform") == 0;
+    if (!platformGiven)
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times load, save, paint, hit-test, queries, delete and print on synthetic "
+                                     "scenes.");
+    parser.addHelpOption();
+    const QCommandLineOption sizesOption("sizes", "Comma-separated shape counts.", "counts",
+                                         "1000,10000,100000,1000000,10000000");
+    const QCommandLineOption repeatOption("repeat", "Samples per measurement.", "n", "5");
+    const QCommandLineOption outputOption({"o", "output"}, "Write results as JSON to this file.", "file");
+    const QCommandLineOption workOption("work-dir", "Directory for scratch scene files (default: temporary).", "dir");
+    parser.addOption(sizesOption);
+    parser.addOption(repeatOption);
+    parser.addOption(outputOption);
+    parser.addOption(workOption);
+    parser.process(a);
+
+    Benchmark::Options options;
+    options.outputPath = parser.value(outputOption);
+    options.workDir = parser.value(workOption);
+
+    bool ok = false;
+    options.repeat = parser.value(repeatOption).toInt(&ok);
+    if (!ok || options.repeat <= 0)
+        parser.showHelp(2);
+
+    options.sizes.clear();
+    for (const QString &size : parser.value(sizesOption).split(',', Qt::SkipEmptyParts))
+    {
+        options.sizes.append(size.trimmed().toInt(&ok));
+        if (!ok || options.sizes.last() <= 0)
+            parser.showHelp(2);
+    }
+    return Benchmark::run(options);
+}
@@ -1,252 +1,966 @@
 #include "canvas.h"
-
+#include "geometrykernels.h"
+#include "profiler.h"
+#include "sceneio.h"
+#include "scenejournal.h"
+#include "shapeeditcommand.h"
+#include "tilerasterizer.h"
+
+#include <QCursor>
+#include <QFutureWatcher>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QResizeEvent>
+#include <QRubberBand>
+#include <QTimer>
 #include <QMouseEvent>
-#include <QFile>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QtMath>
+#include <QUndoStack>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cmath>
 
 Canvas::Canvas(QWidget *parent)
     : QWidget(parent)
+    , undo(new QUndoStack(this))
+    , journalSync(new QTimer(this))
+    , loadWatcher(new QFutureWatcher<AsyncSceneIO::LoadedScene>(this))
 {
     setMinimumSize(297, 210);
     resize(297, 210);
     setAutoFillBackground(true);
+
+    updateView();
+
+    connect(loadWatcher, &QFutureWatcherBase::resultReadyAt, this, &Canvas::showLoadResult);
+    connect(loadWatcher, &QFutureWatcherBase::progressValueChanged, this, &Canvas::loadProgress);
+    connect(loadWatcher, &QFutureWatcherBase::finished, this, &Canvas::finishLoad);
+
+    // Group commit: the edits of one interval reach the disk in one sync
+    journalSync->setSingleShot(true);
+    journalSync->setInterval(journalSyncMs);
+    connect(journalSync, &QTimer::timeout, this, &Canvas::syncJournal);
+}
+
+Canvas::~Canvas()
+{
+    // The commands leave the undo total on the way out, while it is still there
+    undo->clear();
+
+    // The loader only touches its own copy, but its results are not wanted
+    QFuture<AsyncSceneIO::LoadedScene> pending = loadWatcher->future();
+    pending.cancel();
+    pending.waitForFinished();
 }
 
 void Canvas::addRectangle(const QPoint &bottomLeft, const QPoint &topRight)
 {
+    if (loading)
+        return;
+
     QRect rect(QPoint(bottomLeft.x(), topRight.y()), QPoint(topRight.x(), bottomLeft.y()));
-    worldRectangles.append(rect.normalized());
-    update();
+    const ShapeId id = shapes.addRectangle(rect);
+    const ShapeRecord shape = shapes.recordAt(shapes.slotOf(id));
+    index.insert(id, shape.bounds);
+    invalidateShape(shape.bounds);
+    journalChange(shape, true);
+    recordEdit(tr("Add Rectangle"), shape, true);
 }
 
 void Canvas::addCircle(const QPoint &center, int radius)
 {
-    worldCircles.append(qMakePair(center, radius));
-    update();
+    if (loading)
+        return;
+
+    const ShapeId id = shapes.addCircle(center, radius);
+    const ShapeRecord shape = shapes.recordAt(shapes.slotOf(id));
+    index.insert(id, shape.bounds);
+    invalidateShape(shape.bounds);
+    journalChange(shape, true);
+    recordEdit(tr("Add Circle"), shape, true);
+}
+
+ShapeId Canvas::addShapes(const ShapeSpec *specs, int count)
+{
+    if (loading || count <= 0)
+        return InvalidShapeId;
+
+    const int firstSlot = shapes.size();
+    const ShapeId first = shapes.addShapes(specs, count);
+
+    // Past a few hundred shapes, dropping every tile is cheaper than
+    // invalidating them shape by shape
+    const bool repaintAll = count > 256;
+    if (repaintAll)
+        tiles.clear();
+
+    beginTransaction(tr("Add Shapes"));
+    for (int slot = firstSlot; slot < shapes.size(); ++slot)
+    {
+        const ShapeRecord shape = shapes.recordAt(slot);
+        index.insert(shape.id, shape.bounds);
+        if (!repaintAll)
+            invalidateShape(shape.bounds);
+        journalChange(shape, true);
+        transaction->recordAdded(shape);
+    }
+    finishEdit();
+    endTransaction();
+    return first;
 }
 
 void Canvas::deleteSelected()
 {
-    if (selectedRect >= 0 && selectedRect < worldRectangles.size())
-        worldRectangles.removeAt(selectedRect);
-    else if (selectedCircle >= 0 && selectedCircle < worldCircles.size())
-        worldCircles.removeAt(selectedCircle);
+    if (loading)
+        return;
+
+    QVector<ShapeRecord> removed;
+    removed.reserve(selection.size());
+    for (ShapeId id : selection.ids())
+    {
+        const int slot = shapes.slotOf(id);
+        if (slot >= 0)
+            removed.append(shapes.recordAt(slot));
+    }
+    selection.clear();
+
+    if (removed.size() == 1)
+    {
+        eraseShapes(removed);
+        recordEdit(tr("Delete Shape"), removed.first(), false);
+        return;
+    }
 
-    selectedRect = -1;
-    selectedCircle = -1;
+    beginTransaction(tr("Delete Shapes"));
+    eraseShapes(removed);
+    for (const ShapeRecord &shape : removed)
+        transaction->recordRemoved(shape);
+    finishEdit();
+    endTransaction();
+}
+
+void Canvas::selectInRect(const QRect &area, bool extend)
+{
+    if (!extend)
+        selection.clear();
+
+    // The grid narrows the scene to the cells under the box; of those, only
+    // shapes lying wholly inside it count
+    QVector<ShapeId> candidates;
+    index.query(area, candidates);
+    for (ShapeId id : candidates)
+    {
+        const int slot = shapes.slotOf(id);
+        if (slot >= 0 && area.contains(shapes.boundsAt(slot)))
+            selection.insert(id);
+    }
     update();
 }
 
-bool Canvas::saveToFile(const QString &path) const
+void Canvas::clearSelection()
+{
+    selection.clear();
+    update();
+}
+
+int Canvas::selectOverlapping(bool extend)
 {
-    QJsonObject root;
-    QJsonArray rects;
-    for (const QRect &r : worldRectangles)
+    const QVector<GeometryQuery::Overlap> pairs = overlaps();
+    if (!extend)
+        selection.clear();
+    for (const GeometryQuery::Overlap &pair : pairs)
     {
-        QJsonObject rectObj;
-        rectObj["bl_x"] = r.bottomLeft().x();
-        rectObj["bl_y"] = r.bottomLeft().y();
-        rectObj["tr_x"] = r.topRight().x();
-        rectObj["tr_y"] = r.topRight().y();
-        rects.append(rectObj);
+        selection.insert(pair.a);
+        selection.insert(pair.b);
     }
-    root["rectangles"] = rects;
+    update();
+    return pairs.size();
+}
+
+GeometryQuery::Snap Canvas::snapAt(const QPoint &widgetPos) const
+{
+    return GeometryQuery::snapPoint(shapes, index, viewInverse.map(QPointF(widgetPos)), snapRadius / viewScale);
+}
+
+void Canvas::setSnapping(bool on)
+{
+    if (snapping == on)
+        return;
 
-    QJsonArray circArr;
-    for (const auto &c : worldCircles)
+    snapping = on;
+    setMouseTracking(on);
+    if (on)
     {
-        QJsonObject circObj;
-        circObj["cx"] = c.first.x();
-        circObj["cy"] = c.first.y();
-        circObj["r"] = c.second;
-        circArr.append(circObj);
+        updateSnap(mapFromGlobal(QCursor::pos()));
+        return;
     }
-    root["circles"] = circArr;
+    update(snapMarkerRect());
+    snap = GeometryQuery::Snap();
+    emit snapChanged(snap);
+}
 
-    QJsonDocument doc(root);
-    QFile file(path);
-    if (!file.open(QIODevice::WriteOnly))
-        return false;
-    file.write(doc.toJson(QJsonDocument::Compact));
-    return true;
+void Canvas::beginTransaction(const QString &text)
+{
+    if (transactionDepth++ == 0)
+        transaction = new ShapeEditCommand(this, text, 0);
+}
+
+void Canvas::endTransaction()
+{
+    if (transactionDepth == 0 || --transactionDepth > 0)
+        return;
+
+    ShapeEditCommand *command = transaction;
+    transaction = nullptr;
+    if (command->isEmpty())
+        delete command;
+    else
+        pushEdit(command);
+
+    if (repaintPending)
+    {
+        repaintPending = false;
+        flushJournal();
+        update();
+    }
+}
+
+void Canvas::insertShapes(const QVector<ShapeRecord> &records)
+{
+    QVector<ShapeRecord> inserted;
+    inserted.reserve(records.size());
+    for (const ShapeRecord &shape : records)
+    {
+        if (shape.id != InvalidShapeId && !shapes.contains(shape.id))
+            inserted.append(shape);
+    }
+    shapes.restoreMany(inserted);
+
+    const bool repaintAll = inserted.size() > 256;
+    if (repaintAll)
+        tiles.clear();
+    for (const ShapeRecord &shape : inserted)
+    {
+        index.insert(shape.id, shape.bounds);
+        if (!repaintAll)
+            invalidateShape(shape.bounds);
+        journalChange(shape, true);
+    }
+}
+
+void Canvas::eraseShapes(const QVector<ShapeRecord> &records)
+{
+    // Rebuilding the grid beats taking most of it apart item by item
+    const bool reindex = records.size() > shapes.size() / 4;
+    const bool repaintAll = records.size() > 256;
+    if (repaintAll)
+        tiles.clear();
+
+    QVector<ShapeId> ids;
+    ids.reserve(records.size());
+    for (const ShapeRecord &shape : records)
+    {
+        if (!shapes.contains(shape.id))
+            continue;
+        ids.append(shape.id);
+        if (!reindex)
+            index.remove(shape.id, shape.bounds);
+        if (!repaintAll)
+            invalidateShape(shape.bounds);
+        journalChange(shape, false);
+        selection.remove(shape.id);
+    }
+    shapes.removeMany(ids);
+    if (reindex)
+        rebuildIndex();
+}
+
+void Canvas::recordEdit(const QString &text, const ShapeRecord &shape, bool added)
+{
+    if (transaction)
+    {
+        if (added)
+            transaction->recordAdded(shape);
+        else
+            transaction->recordRemoved(shape);
+    }
+    else
+    {
+        auto *command = new ShapeEditCommand(this, text, mergeMs);
+        if (added)
+            command->recordAdded(shape);
+        else
+            command->recordRemoved(shape);
+        pushEdit(command);
+    }
+    finishEdit();
+}
+
+void Canvas::setUndoBudget(qint64 bytes)
+{
+    undoLimitBytes = bytes;
+    trimUndoHistory();
+}
+
+void Canvas::pushEdit(ShapeEditCommand *command)
+{
+    undo->push(command);
+    trimUndoHistory();
+}
+
+void Canvas::trimUndoHistory()
+{
+    if (undoBytes <= undoLimitBytes)
+        return;
+
+    // The newest steps that fit in three quarters of the budget, so the next
+    // trim is a while off; a single step over budget goes too
+    const int last = undo->index();
+    int first = last;
+    qint64 kept = 0;
+    while (first > 0)
+    {
+        const auto *command = static_cast<const ShapeEditCommand *>(undo->command(first - 1));
+        if (kept + command->bytes() > undoLimitBytes / 4 * 3)
+            break;
+        kept += command->bytes();
+        --first;
+    }
+
+    // QUndoStack drops its oldest steps only through a step limit, which it
+    // refuses to change once it holds any, so the kept steps are copied into
+    // a cleared stack. Steps that could be redone are dropped with them.
+    QVector<ShapeEditCommand *> newest;
+    newest.reserve(last - first);
+    for (int i = first; i < last; ++i)
+        newest.append(static_cast<const ShapeEditCommand *>(undo->command(i))->clone());
+    undo->clear();
+    for (ShapeEditCommand *command : newest)
+        undo->push(command);
+}
+
+void Canvas::journalChange(const ShapeRecord &shape, bool added)
+{
+    // A failed append sticks to the journal; flushJournal() deals with it
+    // once the edit is complete
+    if (journal)
+        journal->append(shape, added);
+    else
+        recoveredClean = false; // the scene has moved on from what loadFromFile() replayed
+}
+
+void Canvas::flushJournal()
+{
+    if (!journal)
+        return;
+
+    if (!journal->flush())
+    {
+        recoverJournal();
+        return;
+    }
+    if (!journalSync->isActive())
+        journalSync->start();
+
+    // Rewriting the snapshot once the journal holds records for half the
+    // scene keeps the amortized cost of an edit constant
+    if (journal->pendingRecords() > std::max(4096, shapes.size() / 2) && !journal->isCompacting())
+    {
+        journal->compactInBackground(shapes);
+        if (journal->failed())
+            recoverJournal();
+    }
+}
+
+void Canvas::syncJournal()
+{
+    if (!journal)
+        return;
+    if (!journal->syncInBackground())
+        recoverJournal();
+    else if (journal->hasUnsyncedRecords())
+        journalSync->start(); // the previous sync is still running
+}
+
+void Canvas::recoverJournal()
+{
+    // Edits the journal missed are in shapes: a full snapshot of them starts
+    // a fresh journal. Failing that, edits are no longer logged.
+    if (journal->reset(shapes))
+        return;
+
+    const QString path = journal->snapshotPath();
+    journal.reset();
+    recoveredClean = false;
+    emit journalFailed(path);
+}
+
+void Canvas::finishEdit()
+{
+    // Inside a transaction the journal flush and the repaint wait for
+    // endTransaction()
+    if (transactionDepth > 0)
+    {
+        repaintPending = true;
+        return;
+    }
+    flushJournal();
+    update();
+}
+
+bool Canvas::saveToFile(const QString &path) const
+{
+    if (journal && journal->snapshotPath() == path)
+        return journal->reset(shapes);
+    return SceneIO::save(path, shapes);
 }
 
 bool Canvas::loadFromFile(const QString &path)
 {
-    QFile file(path);
-    if (!file.exists())
+    if (loading)
         return false;
-    if (!file.open(QIODevice::ReadOnly))
+    PROFILE_SCOPE("load", Profiler::Metric::LoadMs);
+    if (journal && journal->snapshotPath() == path)
+        journal->waitForCompaction();
+
+    // Parse into a scratch store so a malformed file leaves the scene intact
+    AsyncSceneIO::LoadedScene scene;
+    scene.path = path;
+    if (!SceneJournal::recover(path, scene.shapes, &scene.generation, &scene.clean))
         return false;
 
-    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-    if (!doc.isObject())
-        return false;
+    commitScene(scene);
+    rebuildIndex();
+    return true;
+}
 
-    worldRectangles.clear();
-    worldCircles.clear();
+QFuture<AsyncSceneIO::LoadedScene> Canvas::loadFromFileAsync(const QString &path)
+{
+    if (loading)
+    {
+        // Let the running load wind down, restoring its scene, first
+        QFuture<AsyncSceneIO::LoadedScene> running = loadWatcher->future();
+        running.cancel();
+        running.waitForFinished();
+        finishLoad();
+    }
+    if (journal && journal->snapshotPath() == path)
+        journal->waitForCompaction();
+
+    // Undo steps would act on previews, or on a scene about to be replaced
+    undo->clear();
+    loading = true;
+    const QFuture<AsyncSceneIO::LoadedScene> future = AsyncSceneIO::load(path);
+    loadWatcher->setFuture(future);
+    return future;
+}
+
+void Canvas::cancelLoad()
+{
+    if (loading)
+        loadWatcher->cancel();
+}
+
+QFuture<bool> Canvas::saveToFileAsync(const QString &path) const
+{
+    if (journal && journal->snapshotPath() == path)
+        return journal->compactInBackground(shapes);
+    return AsyncSceneIO::save(path, shapes);
+}
+
+void Canvas::commitScene(AsyncSceneIO::LoadedScene &scene)
+{
+    // The journal described the scene being replaced
+    journal.reset();
+    recoveredPath = scene.path;
+    recoveredGeneration = scene.generation;
+    recoveredClean = scene.clean;
+
+    // Ids restart with the new scene, so old edits no longer apply
+    undo->clear();
+    shapes = std::move(scene.shapes);
+    index = std::move(scene.index);
+    selection.clear();
+    tiles.clear();
+    update();
+}
 
-    const QJsonObject root = doc.object();
+void Canvas::showLoadResult(int resultIndex)
+{
+    // Notifications from a replaced future may still be queued
+    if (!loading || resultIndex >= loadWatcher->future().resultCount())
+        return;
 
-    const QJsonArray rects = root.value("rectangles").toArray();
-    for (const QJsonValue &v : rects)
+    AsyncSceneIO::LoadedScene scene = loadWatcher->resultAt(resultIndex);
+    if (scene.complete)
     {
-        const QJsonObject o = v.toObject();
-        const int blx = o.value("bl_x").toInt();
-        const int bly = o.value("bl_y").toInt();
-        const int trx = o.value("tr_x").toInt();
-        const int try_ = o.value("tr_y").toInt();
-        QRect rect(QPoint(blx, bly), QPoint(trx, try_));
-        worldRectangles.append(rect.normalized());
+        commitScene(scene);
+        loadCommitted = true;
+        return;
     }
 
-    const QJsonArray circArr = root.value("circles").toArray();
-    for (const QJsonValue &v : circArr)
+    if (!previewing)
     {
-        const QJsonObject o = v.toObject();
-        const int cx = o.value("cx").toInt();
-        const int cy = o.value("cy").toInt();
-        const int r = o.value("r").toInt();
-        if (r > 0)
-            worldCircles.append(qMakePair(QPoint(cx, cy), r));
+        shapesBeforeLoad = std::move(shapes);
+        indexBeforeLoad = std::move(index);
+        previewing = true;
     }
-
+    shapes = std::move(scene.shapes);
+    index = std::move(scene.index);
+    selection.clear();
+    tiles.clear();
     update();
+}
+
+void Canvas::finishLoad()
+{
+    if (!loading || !loadWatcher->isFinished())
+        return;
+
+    if (previewing && !loadCommitted)
+    {
+        shapes = std::move(shapesBeforeLoad);
+        index = std::move(indexBeforeLoad);
+        selection.clear();
+        tiles.clear();
+        update();
+    }
+    shapesBeforeLoad = ShapeStore();
+    indexBeforeLoad = SpatialIndex();
+
+    // The future holds every preview, and shares its columns with the scene
+    // until released; edits would otherwise detach a full copy
+    const bool cancelled = loadWatcher->isCanceled();
+    loadWatcher->setFuture(QFuture<AsyncSceneIO::LoadedScene>());
+
+    const bool ok = loadCommitted;
+    loading = previewing = loadCommitted = false;
+    emit loadFinished(ok, cancelled);
+}
+
+bool Canvas::startJournal(const QString &path)
+{
+    if (SceneIO::formatForPath(path) != SceneIO::Format::Binary)
+        return false;
+
+    journal.reset();
+    auto next = std::make_unique<SceneJournal>(path);
+    const bool resumed = recoveredClean && recoveredPath == path && next->resume(recoveredGeneration);
+    if (!resumed && !next->reset(shapes))
+        return false;
+
+    recoveredPath.clear();
+    recoveredClean = false;
+    journal = std::move(next);
     return true;
 }
 
-void Canvas::paintEvent(QPaintEvent *event)
+void Canvas::setLodSettings(const SceneRenderer::LodSettings &settings)
+{
+    lod = settings;
+    tiles.clear();
+    update();
+}
+
+void Canvas::rebuildIndex()
 {
-    Q_UNUSED(event);
+    index.clear();
+    for (int slot = 0; slot < shapes.size(); ++slot)
+        index.insert(shapes.idAt(slot), shapes.boundsAt(slot));
+}
 
-    QPainter painter(this);
+void Canvas::invalidateShape(const QRect &bounds)
+{
+    const int pad = bleed();
+    tiles.invalidate(bounds.adjusted(-pad, -pad, pad, pad));
+}
+
+QVector<ShapeId> Canvas::paintTile(QPainter &painter, const QPoint &tile) const
+{
+    const QRectF world = tiles.tileRect(tile);
+    const int pad = bleed();
+    QVector<ShapeId> ids;
+    index.query(world.toAlignedRect().adjusted(-pad, -pad, pad, pad), ids);
+
+    // Tile-local origin: world (left, bottom) maps to the image's top-left pixel
     painter.setRenderHint(QPainter::Antialiasing, true);
+    painter.scale(viewScale, viewScale);
+    painter.translate(-world.left(), world.bottom());
+    SceneRenderer::drawShapes(painter, shapes, ids, QPoint(), lod);
+    return ids;
+}
+
+void Canvas::drawTiles(QPainter &painter, const QRect &exposed)
+{
+    const qreal dpr = devicePixelRatioF();
+    tiles.setDevicePixelRatio(dpr);
 
-    painter.fillRect(rect(), QColor(245, 245, 245));
+    const QVector<QPoint> visible = tiles.tilesCovering(viewInverse.mapRect(QRectF(exposed)));
+    QVector<QImage> images(visible.size());
+    QVector<int> missing;
+    for (int i = 0; i < visible.size(); ++i)
+    {
+        if (const QImage *cached = tiles.find(visible.at(i)))
+            images[i] = *cached;
+        else
+            missing.append(i);
+    }
 
-    // Highlight A4 area (210x297) in world coords
-    painter.setPen(QPen(QColor(120, 120, 120), 1, Qt::DashLine));
-    painter.setBrush(QColor(230, 230, 230, 80));
-    QRect a4Rect(QPoint(0, 0), QSize(297, 210));
-    QRect screenA4 = QRect(toScreen(a4Rect.bottomLeft()), toScreen(a4Rect.topRight())).normalized();
-    painter.drawRect(screenA4);
+    if (!visible.isEmpty())
+        PROFILE_RECORD(Profiler::Metric::TileHitRate, 100.0 * (visible.size() - missing.size()) / visible.size());
 
-    painter.setPen(Qt::black);
-    painter.setBrush(QColor(120, 180, 220, 160));
-    for (const auto &circle : worldCircles)
+    // All cache misses are rasterized together, one worker and painter per tile
+    if (!missing.isEmpty())
     {
-        const QPoint c = toScreen(circle.first);
-        painter.drawEllipse(c, circle.second, circle.second);
+        PROFILE_SCOPE("rasterize_tiles");
+        const int pixels = qCeil(TileCache::tileSize * dpr);
+        QVector<QVector<ShapeId>> drawn(missing.size());
+        QVector<ShapeId> *drawnData = drawn.data(); // detach once, before any worker runs
+        const QVector<QImage> rendered = TileRasterizer::render(
+            QVector<QSize>(missing.size(), QSize(pixels, pixels)), dpr, [&](int i, QPainter &tilePainter) {
+                drawnData[i] = paintTile(tilePainter, visible.at(missing.at(i)));
+            });
+
+        // A shape spanning several tiles counts once
+        if (Profiler::isEnabled())
+        {
+            QVector<ShapeId> distinct;
+            for (const QVector<ShapeId> &ids : drawn)
+                distinct += ids;
+            std::sort(distinct.begin(), distinct.end());
+            const qint64 count = std::unique(distinct.begin(), distinct.end()) - distinct.begin();
+            PROFILE_RECORD(Profiler::Metric::ShapesDrawn, double(count));
+            PROFILE_RECORD(Profiler::Metric::ShapesCulled, double(shapes.size() - count));
+        }
+        for (int i = 0; i < missing.size(); ++i)
+        {
+            images[missing.at(i)] = rendered.at(i);
+            tiles.insert(visible.at(missing.at(i)), rendered.at(i));
+        }
     }
 
-    painter.setBrush(QColor(160, 200, 140, 180));
-    for (const QRect &rect : worldRectangles)
+    // The origin sits on a whole pixel, and so does every tile corner
+    const QPoint o = origin();
+    for (int i = 0; i < visible.size(); ++i)
     {
-        painter.drawRect(QRect(toScreen(rect.bottomLeft()), toScreen(rect.topRight())).normalized());
+        const QPoint &tile = visible.at(i);
+        painter.drawImage(QPoint(o.x() + tile.x() * TileCache::tileSize, o.y() - (tile.y() + 1) * TileCache::tileSize),
+                          images.at(i));
     }
+}
 
-    // Highlight selection
+void Canvas::drawBackground(QPainter &painter) const
+{
+    SceneRenderer::drawBackground(painter, rect(), origin(), viewScale);
+}
+
+void Canvas::drawOverlay(QPainter &painter) const
+{
+    // Highlight selection, visiting whichever is smaller: the selection or
+    // the shapes in view
     painter.setPen(QPen(QColor(220, 80, 80), 2, Qt::DashLine));
     painter.setBrush(Qt::NoBrush);
-    if (selectedRect >= 0 && selectedRect < worldRectangles.size())
-    {
-        const QRect r = worldRectangles.at(selectedRect);
-        painter.drawRect(QRect(toScreen(r.bottomLeft()), toScreen(r.topRight())).normalized());
-    }
-    if (selectedCircle >= 0 && selectedCircle < worldCircles.size())
+    const QRect visible = toWorld(rect());
+    QVector<ShapeId> candidates;
+    if (selection.size() <= 1024)
+        candidates = selection.ids();
+    else
+        index.query(visible, candidates);
+
+    for (ShapeId id : candidates)
     {
-        const auto &c = worldCircles.at(selectedCircle);
-        painter.drawEllipse(toScreen(c.first), c.second, c.second);
+        const int slot = shapes.slotOf(id);
+        if (slot < 0 || !selection.contains(id) || !visible.intersects(shapes.boundsAt(slot)))
+            continue;
+        if (shapes.kindAt(slot) == ShapeKind::Rectangle)
+        {
+            const QRect r = shapes.rectAt(slot);
+            painter.drawRect(view.mapRect(QRectF(r.left(), r.top(), r.width(), r.height())));
+        }
+        else
+        {
+            const qreal r = shapes.radiusAt(slot) * viewScale;
+            painter.drawEllipse(view.map(QPointF(shapes.centerAt(slot))), r, r);
+        }
     }
 
-    // Draw simple X/Y axes from the anchor point
-    const int margin = 20;
+    SceneRenderer::drawAxes(painter, rect(), origin(), viewScale);
+}
+
+// A small square around the point the cursor snaps to
+void Canvas::drawSnapMarker(QPainter &painter) const
+{
+    if (!snap.isValid() || !shapes.contains(snap.id))
+        return;
+
+    const QRectF marker = QRectF(snapMarkerRect()).adjusted(1.5, 1.5, -1.5, -1.5);
+    painter.setPen(QPen(QColor(40, 160, 60), 1.5));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawRect(marker);
+}
+
+QRect Canvas::snapMarkerRect() const
+{
+    const QPoint center = view.map(snap.point).toPoint();
+    return QRect(center - QPoint(6, 6), center + QPoint(6, 6));
+}
+
+void Canvas::updateSnap(const QPoint &widgetPos)
+{
+    const GeometryQuery::Snap found = snapAt(widgetPos);
+    if (found.id == snap.id && found.point == snap.point)
+        return;
+
+    if (snap.isValid())
+        update(snapMarkerRect());
+    snap = found;
+    if (snap.isValid())
+        update(snapMarkerRect());
+    emit snapChanged(snap);
+}
+
+void Canvas::paintEvent(QPaintEvent *event)
+{
+    PROFILE_SCOPE("paint", Profiler::Metric::FrameMs);
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+
+    // Shapes come from cached tiles; selection and axes are drawn on top
+    drawBackground(painter);
+    drawTiles(painter, event->rect());
+    drawOverlay(painter);
+    drawSnapMarker(painter);
+}
+
+void Canvas::renderScene(QPainter &painter, const QRect &area) const
+{
+    QVector<ShapeId> ids;
+    index.query(toWorld(area).adjusted(-2, -2, 2, 2), ids);
+    renderScene(painter, ids);
+}
+
+void Canvas::renderScene(QPainter &painter, const QVector<ShapeId> &ids) const
+{
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    drawBackground(painter);
+
+    painter.save();
     const QPoint o = origin();
-    const QPoint xEnd(width() - margin, o.y());
-    const QPoint yEnd(o.x(), margin);
+    painter.translate(o.x(), o.y());
+    painter.scale(viewScale, viewScale);
+    SceneRenderer::drawShapes(painter, shapes, ids, QPoint(), lod);
+    painter.restore();
 
-    painter.setPen(QPen(Qt::darkGray, 2));
-    painter.drawLine(o, xEnd);
-    painter.drawLine(o, yEnd);
+    drawOverlay(painter);
+}
 
-    // Tick marks every 100 px
-    const int tickLen = 6;
-    for (int x = o.x() + 100; x <= xEnd.x(); x += 100)
-    {
-        painter.drawLine(QPoint(x, o.y() - tickLen), QPoint(x, o.y() + tickLen));
-        painter.drawText(QPoint(x - 12, o.y() - 8), QString::number(x - o.x()));
-    }
-    for (int y = o.y() - 100; y >= yEnd.y(); y -= 100)
+QVector<QVector<ShapeId>> Canvas::partitionPages(const PagePipeline::Grid &grid) const
+{
+    // renderScene() grows its query by two world units; pens need a couple
+    // of pixels even when zoomed far out
+    return PagePipeline::partition(shapes, view, grid, qMax<qreal>(2, 2 * viewScale));
+}
+
+void Canvas::zoomBy(qreal factor, const QPointF &anchor)
+{
+    const qreal scale = qBound(minZoom, viewScale * factor, maxZoom);
+    const QPointF world = viewInverse.map(anchor);
+    setView(scale, QPointF(anchor.x() - world.x() * scale, anchor.y() + world.y() * scale));
+}
+
+void Canvas::panBy(const QPoint &delta)
+{
+    setView(viewScale, origin() + delta);
+}
+
+void Canvas::fitToScene()
+{
+    const QRect extent = shapes.extent();
+    if (extent.isEmpty())
     {
-        painter.drawLine(QPoint(o.x() - tickLen, y), QPoint(o.x() + tickLen, y));
-        painter.drawText(QPoint(o.x() + 8, y + 4), QString::number(o.y() - y));
+        resetView();
+        return;
     }
 
-    // Arrow heads
-    painter.drawLine(xEnd, xEnd + QPoint(-8, -5));
-    painter.drawLine(xEnd, xEnd + QPoint(-8, 5));
-    painter.drawLine(yEnd, yEnd + QPoint(-5, -8));
-    painter.drawLine(yEnd, yEnd + QPoint(5, -8));
+    // Shapes cover one unit past their right and top edges, see drawShapes()
+    const QRectF area = QRectF(rect()).adjusted(20, 20, -20, -20);
+    const qreal scale = qBound(minZoom, qMin(area.width() / (extent.width() + 1),
+                                             area.height() / (extent.height() + 1)), maxZoom);
+    const QPointF center(extent.left() + (extent.width() + 1) / 2.0, extent.top() + (extent.height() + 1) / 2.0);
+    setView(scale, QPointF(area.center().x() - center.x() * scale, area.center().y() + center.y() * scale));
+}
 
-    painter.setPen(Qt::darkGray);
-    painter.drawText(xEnd + QPoint(-15, -8), "X");
-    painter.drawText(yEnd + QPoint(8, -12), "Y");
+void Canvas::resetView()
+{
+    setView(1.0, SceneRenderer::viewOrigin(size()));
 }
 
-QPoint Canvas::origin() const
+void Canvas::setView(qreal scale, const QPointF &worldOrigin)
 {
-    return QPoint(40, height() - 40);
+    // Whole pixels keep the tile grid on the pixel grid, so a pan only
+    // moves cached tiles; the bound keeps far pans within int range
+    const qreal limit = 1e9;
+    const QPoint base = SceneRenderer::viewOrigin(size());
+    viewScale = scale;
+    viewPan = QPoint(qRound(qBound(-limit, worldOrigin.x() - base.x(), limit)),
+                     qRound(qBound(-limit, worldOrigin.y() - base.y(), limit)));
+    updateView();
 }
 
-QPoint Canvas::toScreen(const QPoint &world) const
+void Canvas::updateView()
 {
-    // World coordinates: x to the right, y upwards from origin
     const QPoint o = origin();
-    return QPoint(o.x() + world.x(), o.y() - world.y());
+    view = QTransform(viewScale, 0, 0, -viewScale, o.x(), o.y());
+    viewInverse = view.inverted();
+    tiles.setScale(viewScale);
+    update();
+}
+
+int Canvas::bleed() const
+{
+    // How far the antialiased outline reaches into neighbouring tiles: two
+    // pixels past a one unit wide pen
+    return 2 + qCeil(2 / viewScale);
+}
+
+QPoint Canvas::origin() const
+{
+    return SceneRenderer::viewOrigin(size()) + viewPan;
 }
 
 QPoint Canvas::fromScreen(const QPoint &screen) const
 {
-    const QPoint o = origin();
-    return QPoint(screen.x() - o.x(), o.y() - screen.y());
+    // World coordinates: x to the right, y upwards from origin
+    const QPointF world = viewInverse.map(QPointF(screen));
+    return QPoint(qFloor(world.x()), qFloor(world.y()));
 }
 
-void Canvas::mousePressEvent(QMouseEvent *event)
+QRect Canvas::toWorld(const QRect &screen) const
 {
-    const QPoint worldPos = fromScreen(event->pos());
+    return viewInverse.mapRect(QRectF(screen)).toAlignedRect();
+}
 
-    // Check rectangles (topmost last)
-    int foundRect = -1;
-    for (int i = worldRectangles.size() - 1; i >= 0; --i)
+ShapeId Canvas::shapeAt(const QPoint &worldPos) const
+{
+    // Candidates whose bounds contain the point, topmost last
+    QVector<ShapeId> hits;
+    index.queryPoint(worldPos, hits);
+
+    // A rectangle is hit wherever its bounds are, so the topmost one is a
+    // hit outright. Only circles above it can beat it; their boxes are
+    // gathered into columns for one batch disk test.
+    int firstAbove = 0;
+    for (int i = hits.size() - 1; i >= 0; --i)
     {
-        if (worldRectangles.at(i).contains(worldPos))
+        if (shapes.kindAt(shapes.slotOf(hits.at(i))) == ShapeKind::Rectangle)
         {
-            foundRect = i;
+            firstAbove = i + 1;
             break;
         }
     }
+    const ShapeId topRectangle = firstAbove > 0 ? hits.at(firstAbove - 1) : InvalidShapeId;
 
-    // Check circles
-    int foundCircle = -1;
-    for (int i = worldCircles.size() - 1; i >= 0; --i)
+    const int circleCount = hits.size() - firstAbove;
+    if (circleCount == 0)
+        return topRectangle;
+    QVector<qint32> columns(4 * circleCount);
+    for (int i = 0; i < circleCount; ++i)
     {
-        const auto &c = worldCircles.at(i);
-        const QPoint delta = worldPos - c.first;
-        if (QPointF(delta).manhattanLength() <= c.second ||
-            (delta.x() * delta.x() + delta.y() * delta.y()) <= c.second * c.second)
-        {
-            foundCircle = i;
-            break;
-        }
+        const int slot = shapes.slotOf(hits.at(firstAbove + i));
+        columns[i] = shapes.minXAt(slot);
+        columns[circleCount + i] = shapes.minYAt(slot);
+        columns[2 * circleCount + i] = shapes.maxXAt(slot);
+        columns[3 * circleCount + i] = shapes.maxYAt(slot);
     }
+    GeometryKernels::Boxes boxes;
+    boxes.minX = columns.constData();
+    boxes.minY = boxes.minX + circleCount;
+    boxes.maxX = boxes.minY + circleCount;
+    boxes.maxY = boxes.maxX + circleCount;
+    boxes.count = circleCount;
+
+    QVector<int> found(circleCount);
+    const int matched = GeometryKernels::circlesContaining(boxes, worldPos, found.data());
+    return matched > 0 ? hits.at(firstAbove + found.at(matched - 1)) : topRectangle;
+}
 
-    selectedRect = foundRect;
-    selectedCircle = foundCircle;
+void Canvas::mousePressEvent(QMouseEvent *event)
+{
+    PROFILE_SCOPE("mouse_press", Profiler::Metric::MousePressMs);
+    if (event->button() == Qt::MiddleButton)
+    {
+        panning = true;
+        panFrom = event->pos();
+        return;
+    }
+
+    // Ctrl or Shift adds to the selection (a click on a selected shape
+    // takes it out); a press on empty space starts a box selection
+    const bool extend = event->modifiers() & (Qt::ControlModifier | Qt::ShiftModifier);
+    const ShapeId found = shapeAt(fromScreen(event->pos()));
+    if (!extend)
+        selection.clear();
+
+    if (found != InvalidShapeId)
+    {
+        if (extend && selection.contains(found))
+            selection.remove(found);
+        else
+            selection.insert(found);
+    }
+    else
+    {
+        if (!rubberBand)
+            rubberBand = new QRubberBand(QRubberBand::Rectangle, this);
+        bandOrigin = event->pos();
+        bandExtends = extend;
+        rubberBand->setGeometry(QRect(bandOrigin, QSize()));
+        rubberBand->show();
+    }
     update();
 
     QWidget::mousePressEvent(event);
 }
+
+void Canvas::mouseMoveEvent(QMouseEvent *event)
+{
+    if (panning)
+    {
+        panBy(event->pos() - panFrom);
+        panFrom = event->pos();
+    }
+    if (rubberBand && rubberBand->isVisible())
+        rubberBand->setGeometry(QRect(bandOrigin, event->pos()).normalized());
+    if (snapping)
+        updateSnap(event->pos());
+
+    QWidget::mouseMoveEvent(event);
+}
+
+void Canvas::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::MiddleButton)
+        panning = false;
+    if (rubberBand && rubberBand->isVisible())
+    {
+        rubberBand->hide();
+        selectInRect(toWorld(QRect(bandOrigin, event->pos()).normalized()), bandExtends);
+    }
+
+    QWidget::mouseReleaseEvent(event);
+}
+
+void Canvas::wheelEvent(QWheelEvent *event)
+{
+    // One notch (120) zooms by 20%, about the cursor
+    zoomBy(std::pow(1.2, event->angleDelta().y() / 120.0), event->position());
+    event->accept();
+}
+
+void Canvas::resizeEvent(QResizeEvent *event)
+{
+    // The default origin follows the bottom edge
+    updateView();
+    QWidget::resizeEvent(event);
+}
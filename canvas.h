@@ -4,6 +4,25 @@
 #include <QWidget>
 #include <QVector>
 #include <QRect>
+#include <QTransform>
+
+#include <memory>
+
+#include "asyncsceneio.h"
+#include "geometryquery.h"
+#include "pagepipeline.h"
+#include "scenerenderer.h"
+#include "shapeselection.h"
+#include "shapestore.h"
+#include "spatialindex.h"
+#include "tilecache.h"
+
+class QRubberBand;
+class QTimer;
+class QUndoStack;
+template<typename T> class QFutureWatcher;
+class SceneJournal;
+class ShapeEditCommand;
 
 class Canvas : public QWidget
 {
@@ -11,25 +30,203 @@ class Canvas : public QWidget
 
 public:
     explicit Canvas(QWidget *parent = nullptr);
+    ~Canvas() override;
     void addRectangle(const QPoint &bottomLeft, const QPoint &topRight);
     void addCircle(const QPoint &center, int radius);
+    // Adds all shapes as one undo step, with one journal flush and one
+    // repaint; returns the id of the first, the others follow in order
+    ShapeId addShapes(const ShapeSpec *specs, int count);
+    ShapeId addShapes(const QVector<ShapeSpec> &specs) { return addShapes(specs.constData(), specs.size()); }
     void deleteSelected();
+
+    // Clicking selects a shape, dragging on empty space selects every shape
+    // lying wholly inside the box, and Ctrl or Shift extends the selection.
+    // deleteSelected() removes the whole selection as one undo step.
+    const ShapeSelection &selectedShapes() const { return selection; }
+    void selectInRect(const QRect &area, bool extend = false); // world coordinates
+    void clearSelection();
+
+    // Clash detection: every pair of overlapping shapes, see GeometryQuery.
+    // selectOverlapping() selects each shape that overlaps another and
+    // returns the number of pairs.
+    QVector<GeometryQuery::Overlap> overlaps() const { return GeometryQuery::overlaps(shapes); }
+    int selectOverlapping(bool extend = false);
+
+    // Object snapping: the snap point for a widget position, at most
+    // snapRadius pixels away on screen (world coordinates). While snapping is
+    // on, the canvas tracks the mouse, marks the snap point under it and
+    // reports it through snapChanged().
+    GeometryQuery::Snap snapAt(const QPoint &widgetPos) const;
+    const GeometryQuery::Snap &currentSnap() const { return snap; }
+    bool isSnapping() const { return snapping; }
+    void setSnapping(bool on);
+
+    static constexpr int snapRadius = 8;
+
     bool saveToFile(const QString &path) const;
     bool loadFromFile(const QString &path);
 
+    // Loads path on a worker thread. Previews are shown as shapes stream in
+    // and the finished scene replaces the current one in a single step; a
+    // failed or cancelled load puts back the scene shown before. Edits are
+    // ignored and the undo history is dropped while loading. Cancel through
+    // cancelLoad() or the returned future; loadFinished() reports the
+    // outcome. Holding on to the future keeps every preview alive.
+    QFuture<AsyncSceneIO::LoadedScene> loadFromFileAsync(const QString &path);
+    void cancelLoad();
+    bool isLoading() const { return loading; }
+
+    // Saves a copy of the scene on a worker thread. Saving to the journal's
+    // snapshot compacts the journal instead, which is safe to cancel.
+    QFuture<bool> saveToFileAsync(const QString &path) const;
+
+    // Logs every edit to an append-only journal next to the binary snapshot
+    // at path, so an edit costs one small record. An edit survives the
+    // application crashing as soon as it is made, and a power cut once it
+    // is synced: a worker thread syncs the edits of each journalSyncMs
+    // interval together, so the disk has them that long plus one sync later.
+    // Continues the journal loadFromFile(path) just replayed when it can,
+    // otherwise saves a fresh snapshot first. saveToFile(path) then folds
+    // the journal into the snapshot. Should the journal fail to take an
+    // edit, a full snapshot starts it afresh; if that fails too, the journal
+    // is dropped and journalFailed() tells that edits are no longer logged.
+    bool startJournal(const QString &path);
+
+    static constexpr int journalSyncMs = 250;
+
+    // Paints the canvas as the widget shows it, limited to shapes touching
+    // area (widget coordinates). Only reads state, so it may run on any thread.
+    void renderScene(QPainter &painter, const QRect &area) const;
+    // As above, drawing exactly the shapes in ids (z-order)
+    void renderScene(QPainter &painter, const QVector<ShapeId> &ids) const;
+    // The shapes each page of grid shows, for the canvas cut into pages as
+    // the widget shows it (widget coordinates)
+    QVector<QVector<ShapeId>> partitionPages(const PagePipeline::Grid &grid) const;
+
+    // The view: zoom is pixels per world unit, and panning moves world (0, 0)
+    // away from its spot in the bottom-left corner. The world-to-widget
+    // transform is cached and only recomputed when the view changes. Panning
+    // reuses the rendered tiles; zooming renders them anew. The middle mouse
+    // button pans and the wheel zooms about the cursor.
+    qreal zoom() const { return viewScale; }
+    const QTransform &viewTransform() const { return view; }
+    void zoomBy(qreal factor, const QPointF &anchor); // keeps the world point under anchor in place
+    void zoomBy(qreal factor) { zoomBy(factor, QRectF(rect()).center()); }
+    void panBy(const QPoint &delta);
+    void fitToScene();
+    void resetView();
+
+    static constexpr qreal minZoom = 1.0 / 4096;
+    static constexpr qreal maxZoom = 256;
+
+    const SceneRenderer::LodSettings &lodSettings() const { return lod; }
+    void setLodSettings(const SceneRenderer::LodSettings &settings);
+
+    // Every edit is recorded here; loading a scene clears the history
+    QUndoStack *undoStack() const { return undo; }
+
+    // Edits between begin and end form one undo step and one repaint.
+    // Transactions nest; only the outermost one is recorded.
+    void beginTransaction(const QString &text);
+    void endTransaction();
+
+    // Consecutive edits of the same kind closer than this many ms merge into
+    // one undo step; 0 keeps every edit separate
+    int mergeInterval() const { return mergeMs; }
+    void setMergeInterval(int ms) { mergeMs = ms; }
+
+    // The undo history drops its oldest steps once the shapes they record
+    // take more than this many bytes
+    static constexpr qint64 defaultUndoBudget = qint64(64) << 20;
+    qint64 undoBudget() const { return undoLimitBytes; }
+    void setUndoBudget(qint64 bytes);
+
+signals:
+    void loadProgress(int permille);
+    void loadFinished(bool ok, bool cancelled);
+    void journalFailed(const QString &snapshotPath);
+    void snapChanged(const GeometryQuery::Snap &snap);
+
 protected:
     void paintEvent(QPaintEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
 
 private:
-    QVector<QRect> worldRectangles;
-    QVector<QPair<QPoint, int>> worldCircles;
+    friend class ShapeEditCommand;
+
+    ShapeStore shapes;
+    SpatialIndex index;
+    TileCache tiles;
+    SceneRenderer::LodSettings lod;
+    void rebuildIndex();
+    void commitScene(AsyncSceneIO::LoadedScene &scene);
+    void showLoadResult(int resultIndex);
+    void finishLoad();
+    void insertShapes(const QVector<ShapeRecord> &records);
+    void eraseShapes(const QVector<ShapeRecord> &records);
+    ShapeId shapeAt(const QPoint &worldPos) const;
+    void recordEdit(const QString &text, const ShapeRecord &shape, bool added);
+    void pushEdit(ShapeEditCommand *command);
+    void trimUndoHistory();
+    void finishEdit();
+    void journalChange(const ShapeRecord &shape, bool added);
+    void syncJournal();
+    void recoverJournal();
+    void flushJournal();
+    void invalidateShape(const QRect &bounds);
+    void drawBackground(QPainter &painter) const;
+    void drawTiles(QPainter &painter, const QRect &exposed);
+    QVector<ShapeId> paintTile(QPainter &painter, const QPoint &tile) const; // returns the shapes drawn
+    void drawOverlay(QPainter &painter) const;
+    void drawSnapMarker(QPainter &painter) const;
+    QRect snapMarkerRect() const;
+    void updateSnap(const QPoint &widgetPos);
+    void setView(qreal scale, const QPointF &worldOrigin);
+    void updateView();
+    int bleed() const;
     QPoint origin() const;
-    QPoint toScreen(const QPoint &world) const;
     QPoint fromScreen(const QPoint &screen) const;
+    QRect toWorld(const QRect &screen) const;
+
+    qreal viewScale = 1.0;
+    QPoint viewPan;          // of world (0, 0) from SceneRenderer::viewOrigin()
+    QTransform view;         // world to widget
+    QTransform viewInverse;
+    bool panning = false;
+    QPoint panFrom;
+
+    ShapeSelection selection;
+    QRubberBand *rubberBand = nullptr;
+    QPoint bandOrigin;
+    bool bandExtends = false;
+
+    bool snapping = false;
+    GeometryQuery::Snap snap;
+
+    QUndoStack *undo = nullptr;
+    ShapeEditCommand *transaction = nullptr;
+    int transactionDepth = 0;
+    bool repaintPending = false;
+    int mergeMs = 0;
+    qint64 undoBytes = 0; // held by the commands on the undo stack
+    qint64 undoLimitBytes = defaultUndoBudget;
+
+    std::unique_ptr<SceneJournal> journal;
+    QTimer *journalSync = nullptr;
+    QString recoveredPath; // what loadFromFile() last replayed, for startJournal()
+    quint64 recoveredGeneration = 0;
+    bool recoveredClean = false;
 
-    int selectedRect = -1;
-    int selectedCircle = -1;
+    QFutureWatcher<AsyncSceneIO::LoadedScene> *loadWatcher = nullptr;
+    bool loading = false;
+    bool loadCommitted = false;
+    bool previewing = false;
+    ShapeStore shapesBeforeLoad; // the scene to put back if a previewed load fails
+    SpatialIndex indexBeforeLoad;
 };
 
 #endif // CANVAS_H
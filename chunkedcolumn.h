@@ -0,0 +1,237 @@
+#ifndef CHUNKEDCOLUMN_H
+#define CHUNKEDCOLUMN_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSharedData>
+#include <QSharedDataPointer>
+#include <QVector>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <type_traits>
+
+// Fixed-size blocks of BlockSize bytes. Freed blocks go on a free list for
+// the next allocation rather than back to the heap, so the detach after a
+// snapshot does not pay for malloc. Up to 32 MB of free blocks are kept.
+// Blocks may be freed on any thread, e.g. when a background save drops its
+// snapshot.
+template<std::size_t BlockSize>
+class BlockArena
+{
+public:
+    static void *allocate()
+    {
+        State &s = state();
+        {
+            const QMutexLocker locker(&s.mutex);
+            if (FreeBlock *block = s.free)
+            {
+                s.free = block->next;
+                --s.freeCount;
+                return block;
+            }
+        }
+        return ::operator new(BlockSize);
+    }
+
+    static void release(void *block)
+    {
+        State &s = state();
+        {
+            const QMutexLocker locker(&s.mutex);
+            if (s.freeCount < maxFree)
+            {
+                s.free = new (block) FreeBlock{s.free};
+                ++s.freeCount;
+                return;
+            }
+        }
+        ::operator delete(block);
+    }
+
+private:
+    static_assert(BlockSize >= sizeof(void *), "blocks must hold a free-list link");
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    struct State
+    {
+        QMutex mutex;
+        FreeBlock *free = nullptr;
+        int freeCount = 0;
+    };
+
+    static constexpr int maxFree = int(std::max<std::size_t>(1, (32u << 20) / BlockSize));
+
+    static State &state()
+    {
+        static State instance;
+        return instance;
+    }
+};
+
+// A column of T stored as chunks of chunkSize entries, each implicitly
+// shared. Copying a column copies only the chunk pointers, so a copy is a
+// cheap snapshot; a write then detaches just the chunk it lands in, and the
+// snapshot keeps the rest in common with the live column. T must be
+// trivially copyable.
+template<typename T>
+class ChunkedColumn
+{
+public:
+    static constexpr int chunkShift = 12;
+    static constexpr int chunkSize = 1 << chunkShift;
+
+private:
+    struct Chunk : QSharedData
+    {
+        T values[chunkSize];
+
+        static void *operator new(std::size_t) { return BlockArena<sizeof(Chunk)>::allocate(); }
+        static void operator delete(void *block) { BlockArena<sizeof(Chunk)>::release(block); }
+    };
+
+    static_assert(std::is_trivially_copyable<T>::value, "chunks are copied bytewise");
+
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = int;
+        using pointer = const T *;
+        using reference = const T &;
+
+        const_iterator() = default;
+        const_iterator(const ChunkedColumn *column, int index) : column(column), index(index) {}
+
+        reference operator*() const { return column->at(index); }
+        reference operator[](int n) const { return column->at(index + n); }
+        const_iterator &operator++()
+        {
+            ++index;
+            return *this;
+        }
+        const_iterator operator++(int) { return const_iterator(column, index++); }
+        const_iterator &operator--()
+        {
+            --index;
+            return *this;
+        }
+        const_iterator operator--(int) { return const_iterator(column, index--); }
+        const_iterator &operator+=(int n)
+        {
+            index += n;
+            return *this;
+        }
+        const_iterator &operator-=(int n)
+        {
+            index -= n;
+            return *this;
+        }
+        const_iterator operator+(int n) const { return const_iterator(column, index + n); }
+        const_iterator operator-(int n) const { return const_iterator(column, index - n); }
+        friend const_iterator operator+(int n, const const_iterator &it) { return it + n; }
+        int operator-(const const_iterator &other) const { return index - other.index; }
+        bool operator==(const const_iterator &other) const { return index == other.index; }
+        bool operator!=(const const_iterator &other) const { return index != other.index; }
+        bool operator<(const const_iterator &other) const { return index < other.index; }
+        bool operator>(const const_iterator &other) const { return index > other.index; }
+        bool operator<=(const const_iterator &other) const { return index <= other.index; }
+        bool operator>=(const const_iterator &other) const { return index >= other.index; }
+
+    private:
+        const ChunkedColumn *column = nullptr;
+        int index = 0;
+    };
+
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+
+    const T &at(int i) const { return chunks.at(i >> chunkShift)->values[i & mask]; }
+    const T &last() const { return at(count - 1); }
+    // Detaches the chunk holding i if a snapshot shares it
+    void set(int i, const T &value) { chunks[i >> chunkShift]->values[i & mask] = value; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+    void append(const T &value)
+    {
+        if ((count >> chunkShift) == chunks.size())
+            chunks.append(QSharedDataPointer<Chunk>(new Chunk));
+        set(count++, value);
+    }
+
+    // Appends n values, filling the last chunk and then whole new ones
+    void append(const T *values, int n)
+    {
+        while (n > 0)
+        {
+            if ((count >> chunkShift) == chunks.size())
+                chunks.append(QSharedDataPointer<Chunk>(new Chunk));
+            const int offset = count & mask;
+            const int take = std::min(n, chunkSize - offset);
+            std::copy(values, values + take, chunks[count >> chunkShift]->values + offset);
+            count += take;
+            values += take;
+            n -= take;
+        }
+    }
+
+    // Shifts every later entry up by one, detaching their chunks
+    void insert(int i, const T &value)
+    {
+        append(value);
+        for (int j = count - 1; j > i; --j)
+            set(j, at(j - 1));
+        set(i, value);
+    }
+
+    void removeLast()
+    {
+        --count;
+        if ((count & mask) == 0)
+            chunks.removeLast();
+    }
+
+    void resize(int size, const T &value = T())
+    {
+        if (size < count)
+        {
+            count = size;
+            chunks.resize((size + mask) >> chunkShift);
+        }
+        while (count < size)
+            append(value);
+    }
+
+    void clear()
+    {
+        chunks.clear();
+        count = 0;
+    }
+
+    void reserve(int size) { chunks.reserve((size + mask) >> chunkShift); }
+
+    // Contiguous runs for batch kernels: chunk c holds entries
+    // [c * chunkSize, c * chunkSize + chunkLength(c))
+    int chunkCount() const { return chunks.size(); }
+    const T *chunkData(int c) const { return chunks.at(c)->values; }
+    int chunkLength(int c) const { return std::min(chunkSize, count - (c << chunkShift)); }
+
+private:
+    static constexpr int mask = chunkSize - 1;
+
+    QVector<QSharedDataPointer<Chunk>> chunks;
+    int count = 0;
+};
+
+#endif // CHUNKEDCOLUMN_H
@@ -0,0 +1,175 @@
+#include "csvimporter.h"
+
+#include <QByteArray>
+#include <QFile>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+void skipBlanks(const char *&p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+}
+
+bool readInt(const char *&p, const char *end, int &value)
+{
+    skipBlanks(p, end);
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        ++p;
+    if (p >= end || *p < '0' || *p > '9')
+        return false;
+
+    qint64 magnitude = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        magnitude = magnitude * 10 + (*p++ - '0');
+        if (magnitude > qint64(std::numeric_limits<int>::max()) + 1)
+            return false;
+    }
+    const qint64 v = negative ? -magnitude : magnitude;
+    if (v > std::numeric_limits<int>::max())
+        return false;
+    value = int(v);
+    skipBlanks(p, end);
+    return true;
+}
+
+// Reads count comma-prefixed integers that must end the line
+bool readFields(const char *p, const char *end, int *fields, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (p >= end || *p++ != ',' || !readInt(p, end, fields[i]))
+            return false;
+    }
+    return p == end;
+}
+
+bool tokenIs(const char *token, qsizetype len, const char *word)
+{
+    return qsizetype(std::strlen(word)) == len && std::memcmp(token, word, size_t(len)) == 0;
+}
+
+enum class LineResult
+{
+    Shape,
+    Skipped,
+    UnknownKind,
+    BadFields
+};
+
+LineResult parseLine(const char *p, const char *end, ShapeSpec &shape)
+{
+    skipBlanks(p, end);
+    if (p == end || *p == '#')
+        return LineResult::Skipped;
+
+    const char *token = p;
+    while (p < end && *p != ',' && *p != ' ' && *p != '\t')
+        ++p;
+    const qsizetype len = p - token;
+    skipBlanks(p, end);
+
+    int fields[4];
+    if (tokenIs(token, len, "rect") || tokenIs(token, len, "rectangle"))
+    {
+        if (!readFields(p, end, fields, 4))
+            return LineResult::BadFields;
+        shape = ShapeSpec::rectangle(QRect(QPoint(fields[0], fields[1]), QPoint(fields[2], fields[3])));
+        return LineResult::Shape;
+    }
+    if (tokenIs(token, len, "circle"))
+    {
+        if (!readFields(p, end, fields, 3) || fields[2] <= 0)
+            return LineResult::BadFields;
+        shape = ShapeSpec::circle(QPoint(fields[0], fields[1]), fields[2]);
+        return LineResult::Shape;
+    }
+    return LineResult::UnknownKind;
+}
+
+} // namespace
+
+namespace CsvImporter {
+
+bool parse(const char *data, qint64 size, QVector<ShapeSpec> &shapes, QString *error)
+{
+    const char *p = data;
+    const char *end = data + size;
+    if (size >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+        p += 3;
+
+    // One line per shape at most, so counting lines sizes the vector once
+    const int initialSize = shapes.size();
+    shapes.reserve(initialSize + int(std::count(p, end, '\n')) + 1);
+
+    int line = 0;
+    bool headerAllowed = true;
+    while (p < end)
+    {
+        ++line;
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        if (!eol)
+            eol = end;
+        const char *lineEnd = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+
+        ShapeSpec shape;
+        const LineResult result = parseLine(p, lineEnd, shape);
+        if (result == LineResult::Shape)
+            shapes.append(shape);
+        else if (result == LineResult::UnknownKind && !headerAllowed)
+        {
+            if (error)
+                *error = QString("line %1: unknown shape kind").arg(line);
+            shapes.resize(initialSize);
+            return false;
+        }
+        else if (result == LineResult::BadFields)
+        {
+            if (error)
+                *error = QString("line %1: expected rect,bl_x,bl_y,tr_x,tr_y or circle,cx,cy,r").arg(line);
+            shapes.resize(initialSize);
+            return false;
+        }
+        // Only the first line with content may be a header
+        if (result != LineResult::Skipped)
+            headerAllowed = false;
+        p = eol + 1;
+    }
+    return true;
+}
+
+bool read(const QString &path, QVector<ShapeSpec> &shapes, QString *error)
+{
+    QFile file(path);
+    const bool opened = path == "-" ? file.open(stdin, QIODevice::ReadOnly) : file.open(QIODevice::ReadOnly);
+    if (!opened)
+    {
+        if (error)
+            *error = QString("cannot open %1").arg(path);
+        return false;
+    }
+
+    const qint64 size = file.size();
+    if (size > 0 && !file.isSequential())
+    {
+        if (uchar *mapped = file.map(0, size))
+        {
+            const bool ok = parse(reinterpret_cast<const char *>(mapped), size, shapes, error);
+            file.unmap(mapped);
+            return ok;
+        }
+    }
+
+    // Pipes and files that cannot be mapped are read in full
+    const QByteArray data = file.readAll();
+    return parse(data.constData(), data.size(), shapes, error);
+}
+
+} // namespace CsvImporter
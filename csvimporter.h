@@ -0,0 +1,27 @@
+#ifndef CSVIMPORTER_H
+#define CSVIMPORTER_H
+
+#include <QString>
+#include <QVector>
+
+#include "shapestore.h"
+
+// Shape lists written by scripts and spreadsheets, one shape per line:
+//   rect,<bl_x>,<bl_y>,<tr_x>,<tr_y>
+//   circle,<cx>,<cy>,<r>
+// "rectangle" is accepted for "rect". Coordinates are integers; fields may
+// be padded with blanks and lines may end in CRLF. Blank lines and lines
+// starting with '#' are skipped, and so is the first other line if it does
+// not name a shape kind (a header).
+namespace CsvImporter {
+
+// Appends the shapes in data to shapes. On failure shapes is left as it was
+// and error names the offending line.
+bool parse(const char *data, qint64 size, QVector<ShapeSpec> &shapes, QString *error = nullptr);
+
+// Parses a file, memory-mapped when possible; "-" reads standard input.
+bool read(const QString &path, QVector<ShapeSpec> &shapes, QString *error = nullptr);
+
+} // namespace CsvImporter
+
+#endif // CSVIMPORTER_H
@@ -0,0 +1,529 @@
+#include "geometrykernels.h"
+
+#include <QAtomicInteger>
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GEOMETRYKERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile intrinsics only in functions built for their
+// instruction set; MSVC accepts them anywhere
+#if defined(GEOMETRYKERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+namespace {
+
+using GeometryKernels::Boxes;
+using GeometryKernels::Isa;
+
+// Scalar kernels, also used for the tails the vector loops leave over
+
+QRect uniteScalar(const Boxes &b, int from, qint32 bounds[4])
+{
+    for (int i = from; i < b.count; ++i)
+    {
+        bounds[0] = std::min(bounds[0], b.minX[i]);
+        bounds[1] = std::min(bounds[1], b.minY[i]);
+        bounds[2] = std::max(bounds[2], b.maxX[i]);
+        bounds[3] = std::max(bounds[3], b.maxY[i]);
+    }
+    return QRect(QPoint(bounds[0], bounds[1]), QPoint(bounds[2], bounds[3]));
+}
+
+void transformScalar(const qint32 *x, const qint32 *y, int from, int count, double scaleX, double dx,
+                     double scaleY, double dy, double *outX, double *outY)
+{
+    for (int i = from; i < count; ++i)
+    {
+        outX[i] = x[i] * scaleX + dx;
+        outY[i] = y[i] * scaleY + dy;
+    }
+}
+
+int containingScalar(const Boxes &b, int from, const QPoint &p, int *out, int found)
+{
+    for (int i = from; i < b.count; ++i)
+    {
+        if (b.minX[i] <= p.x() && p.x() <= b.maxX[i] && b.minY[i] <= p.y() && p.y() <= b.maxY[i])
+            out[found++] = i;
+    }
+    return found;
+}
+
+int intersectingScalar(const Boxes &b, int from, const QRect &area, int *out, int found)
+{
+    for (int i = from; i < b.count; ++i)
+    {
+        if (b.minX[i] <= area.right() && area.left() <= b.maxX[i] && b.minY[i] <= area.bottom()
+            && area.top() <= b.maxY[i])
+            out[found++] = i;
+    }
+    return found;
+}
+
+int circlesContainingScalar(const Boxes &b, int from, const QPoint &p, int *out, int found)
+{
+    for (int i = from; i < b.count; ++i)
+    {
+        if (GeometryKernels::circleContains(b.minX[i], b.minY[i], b.maxX[i], b.maxY[i], p))
+            out[found++] = i;
+    }
+    return found;
+}
+
+// Appends base + the position of every set bit in mask, lowest first
+inline int appendMatches(unsigned mask, int base, int *out, int found)
+{
+    for (; mask != 0; mask &= mask - 1)
+        out[found++] = base + int(qCountTrailingZeroBits(mask));
+    return found;
+}
+
+#ifdef GEOMETRYKERNELS_X86
+
+bool cpuSupports(Isa isa)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return isa == Isa::Avx2 ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("sse4.1");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    if (isa == Isa::Sse41)
+        return info[2] & (1 << 19);
+
+    // AVX2 also needs the OS to save the YMM registers
+    const bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    Q_UNUSED(isa);
+    return false;
+#endif
+}
+
+// SSE4.1: four int32 or two double lanes
+
+KERNEL_TARGET("sse4.1")
+QRect uniteSse41(const Boxes &b)
+{
+    __m128i lo0 = _mm_set1_epi32(std::numeric_limits<qint32>::max());
+    __m128i lo1 = lo0;
+    __m128i hi0 = _mm_set1_epi32(std::numeric_limits<qint32>::min());
+    __m128i hi1 = hi0;
+    int i = 0;
+    for (; i + 4 <= b.count; i += 4)
+    {
+        lo0 = _mm_min_epi32(lo0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.minX + i)));
+        lo1 = _mm_min_epi32(lo1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.minY + i)));
+        hi0 = _mm_max_epi32(hi0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.maxX + i)));
+        hi1 = _mm_max_epi32(hi1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.maxY + i)));
+    }
+
+    alignas(16) qint32 lanes[4][4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[0]), lo0);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[1]), lo1);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[2]), hi0);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[3]), hi1);
+    qint32 bounds[4] = {lanes[0][0], lanes[1][0], lanes[2][0], lanes[3][0]};
+    for (int lane = 1; lane < 4; ++lane)
+    {
+        bounds[0] = std::min(bounds[0], lanes[0][lane]);
+        bounds[1] = std::min(bounds[1], lanes[1][lane]);
+        bounds[2] = std::max(bounds[2], lanes[2][lane]);
+        bounds[3] = std::max(bounds[3], lanes[3][lane]);
+    }
+    return uniteScalar(b, i, bounds);
+}
+
+KERNEL_TARGET("sse4.1")
+void transformSse41(const qint32 *x, const qint32 *y, int count, double scaleX, double dx, double scaleY,
+                    double dy, double *outX, double *outY)
+{
+    const __m128d sx = _mm_set1_pd(scaleX);
+    const __m128d sy = _mm_set1_pd(scaleY);
+    const __m128d tx = _mm_set1_pd(dx);
+    const __m128d ty = _mm_set1_pd(dy);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128d vx = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i)));
+        const __m128d vy = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + i)));
+        _mm_storeu_pd(outX + i, _mm_add_pd(_mm_mul_pd(vx, sx), tx));
+        _mm_storeu_pd(outY + i, _mm_add_pd(_mm_mul_pd(vy, sy), ty));
+    }
+    transformScalar(x, y, i, count, scaleX, dx, scaleY, dy, outX, outY);
+}
+
+// Lanes where lo <= v <= hi fails, for four int32 lanes
+KERNEL_TARGET("sse4.1")
+inline __m128i outsideSse41(__m128i lo, __m128i v, __m128i hi)
+{
+    return _mm_or_si128(_mm_cmpgt_epi32(lo, v), _mm_cmpgt_epi32(v, hi));
+}
+
+KERNEL_TARGET("sse4.1")
+int containingSse41(const Boxes &b, const QPoint &p, int *out)
+{
+    const __m128i px = _mm_set1_epi32(p.x());
+    const __m128i py = _mm_set1_epi32(p.y());
+    int found = 0;
+    int i = 0;
+    for (; i + 4 <= b.count; i += 4)
+    {
+        const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.minX + i));
+        const __m128i y0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.minY + i));
+        const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.maxX + i));
+        const __m128i y1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.maxY + i));
+        const __m128i outside = _mm_or_si128(outsideSse41(x0, px, x1), outsideSse41(y0, py, y1));
+        found = appendMatches(~unsigned(_mm_movemask_ps(_mm_castsi128_ps(outside))) & 0xf, i, out, found);
+    }
+    return containingScalar(b, i, p, out, found);
+}
+
+KERNEL_TARGET("sse4.1")
+int intersectingSse41(const Boxes &b, const QRect &area, int *out)
+{
+    const __m128i left = _mm_set1_epi32(area.left());
+    const __m128i top = _mm_set1_epi32(area.top());
+    const __m128i right = _mm_set1_epi32(area.right());
+    const __m128i bottom = _mm_set1_epi32(area.bottom());
+    int found = 0;
+    int i = 0;
+    for (; i + 4 <= b.count; i += 4)
+    {
+        const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.minX + i));
+        const __m128i y0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.minY + i));
+        const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.maxX + i));
+        const __m128i y1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b.maxY + i));
+        const __m128i apart = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(x0, right), _mm_cmpgt_epi32(left, x1)),
+                                           _mm_or_si128(_mm_cmpgt_epi32(y0, bottom), _mm_cmpgt_epi32(top, y1)));
+        found = appendMatches(~unsigned(_mm_movemask_ps(_mm_castsi128_ps(apart))) & 0xf, i, out, found);
+    }
+    return intersectingScalar(b, i, area, out, found);
+}
+
+KERNEL_TARGET("sse4.1")
+inline __m128d loadDoublesSse41(const qint32 *column)
+{
+    return _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(column)));
+}
+
+// Two circles at a time; see GeometryKernels::circleContains()
+KERNEL_TARGET("sse4.1")
+inline unsigned circlesSse41(const Boxes &b, int i, __m128d px, __m128d py)
+{
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d x0 = loadDoublesSse41(b.minX + i);
+    const __m128d y0 = loadDoublesSse41(b.minY + i);
+    const __m128d x1 = loadDoublesSse41(b.maxX + i);
+    const __m128d y1 = loadDoublesSse41(b.maxY + i);
+    const int toZero = _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC;
+    const __m128d dx = _mm_sub_pd(px, _mm_round_pd(_mm_mul_pd(_mm_add_pd(x0, x1), half), toZero));
+    const __m128d dy = _mm_sub_pd(py, _mm_round_pd(_mm_mul_pd(_mm_add_pd(y0, y1), half), toZero));
+    const __m128d r = _mm_round_pd(_mm_mul_pd(_mm_sub_pd(x1, x0), half), toZero);
+    const __m128d inside = _mm_cmple_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(r, r));
+    return unsigned(_mm_movemask_pd(inside));
+}
+
+KERNEL_TARGET("sse4.1")
+int circlesContainingSse41(const Boxes &b, const QPoint &p, int *out)
+{
+    const __m128d px = _mm_set1_pd(p.x());
+    const __m128d py = _mm_set1_pd(p.y());
+    int found = 0;
+    int i = 0;
+    for (; i + 2 <= b.count; i += 2)
+        found = appendMatches(circlesSse41(b, i, px, py), i, out, found);
+    return circlesContainingScalar(b, i, p, out, found);
+}
+
+// AVX2: eight int32 or four double lanes
+
+KERNEL_TARGET("avx2")
+QRect uniteAvx2(const Boxes &b)
+{
+    __m256i lo0 = _mm256_set1_epi32(std::numeric_limits<qint32>::max());
+    __m256i lo1 = lo0;
+    __m256i hi0 = _mm256_set1_epi32(std::numeric_limits<qint32>::min());
+    __m256i hi1 = hi0;
+    int i = 0;
+    for (; i + 8 <= b.count; i += 8)
+    {
+        lo0 = _mm256_min_epi32(lo0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.minX + i)));
+        lo1 = _mm256_min_epi32(lo1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.minY + i)));
+        hi0 = _mm256_max_epi32(hi0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.maxX + i)));
+        hi1 = _mm256_max_epi32(hi1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.maxY + i)));
+    }
+
+    alignas(32) qint32 lanes[4][8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[0]), lo0);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[1]), lo1);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[2]), hi0);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[3]), hi1);
+    qint32 bounds[4] = {lanes[0][0], lanes[1][0], lanes[2][0], lanes[3][0]};
+    for (int lane = 1; lane < 8; ++lane)
+    {
+        bounds[0] = std::min(bounds[0], lanes[0][lane]);
+        bounds[1] = std::min(bounds[1], lanes[1][lane]);
+        bounds[2] = std::max(bounds[2], lanes[2][lane]);
+        bounds[3] = std::max(bounds[3], lanes[3][lane]);
+    }
+    return uniteScalar(b, i, bounds);
+}
+
+KERNEL_TARGET("avx2")
+void transformAvx2(const qint32 *x, const qint32 *y, int count, double scaleX, double dx, double scaleY,
+                   double dy, double *outX, double *outY)
+{
+    const __m256d sx = _mm256_set1_pd(scaleX);
+    const __m256d sy = _mm256_set1_pd(scaleY);
+    const __m256d tx = _mm256_set1_pd(dx);
+    const __m256d ty = _mm256_set1_pd(dy);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256d vx = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)));
+        const __m256d vy = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i)));
+        _mm256_storeu_pd(outX + i, _mm256_add_pd(_mm256_mul_pd(vx, sx), tx));
+        _mm256_storeu_pd(outY + i, _mm256_add_pd(_mm256_mul_pd(vy, sy), ty));
+    }
+    transformScalar(x, y, i, count, scaleX, dx, scaleY, dy, outX, outY);
+}
+
+KERNEL_TARGET("avx2")
+inline __m256i outsideAvx2(__m256i lo, __m256i v, __m256i hi)
+{
+    return _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+}
+
+KERNEL_TARGET("avx2")
+int containingAvx2(const Boxes &b, const QPoint &p, int *out)
+{
+    const __m256i px = _mm256_set1_epi32(p.x());
+    const __m256i py = _mm256_set1_epi32(p.y());
+    int found = 0;
+    int i = 0;
+    for (; i + 8 <= b.count; i += 8)
+    {
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.minX + i));
+        const __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.minY + i));
+        const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.maxX + i));
+        const __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.maxY + i));
+        const __m256i outside = _mm256_or_si256(outsideAvx2(x0, px, x1), outsideAvx2(y0, py, y1));
+        found = appendMatches(~unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(outside))) & 0xff, i, out, found);
+    }
+    return containingScalar(b, i, p, out, found);
+}
+
+KERNEL_TARGET("avx2")
+int intersectingAvx2(const Boxes &b, const QRect &area, int *out)
+{
+    const __m256i left = _mm256_set1_epi32(area.left());
+    const __m256i top = _mm256_set1_epi32(area.top());
+    const __m256i right = _mm256_set1_epi32(area.right());
+    const __m256i bottom = _mm256_set1_epi32(area.bottom());
+    int found = 0;
+    int i = 0;
+    for (; i + 8 <= b.count; i += 8)
+    {
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.minX + i));
+        const __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.minY + i));
+        const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.maxX + i));
+        const __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.maxY + i));
+        const __m256i apart =
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(x0, right), _mm256_cmpgt_epi32(left, x1)),
+                            _mm256_or_si256(_mm256_cmpgt_epi32(y0, bottom), _mm256_cmpgt_epi32(top, y1)));
+        found = appendMatches(~unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(apart))) & 0xff, i, out, found);
+    }
+    return intersectingScalar(b, i, area, out, found);
+}
+
+KERNEL_TARGET("avx2")
+inline __m256d loadDoublesAvx2(const qint32 *column)
+{
+    return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i *>(column)));
+}
+
+// Four circles at a time; see GeometryKernels::circleContains()
+KERNEL_TARGET("avx2")
+inline unsigned circlesAvx2(const Boxes &b, int i, __m256d px, __m256d py)
+{
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d x0 = loadDoublesAvx2(b.minX + i);
+    const __m256d y0 = loadDoublesAvx2(b.minY + i);
+    const __m256d x1 = loadDoublesAvx2(b.maxX + i);
+    const __m256d y1 = loadDoublesAvx2(b.maxY + i);
+    const int toZero = _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC;
+    const __m256d dx = _mm256_sub_pd(px, _mm256_round_pd(_mm256_mul_pd(_mm256_add_pd(x0, x1), half), toZero));
+    const __m256d dy = _mm256_sub_pd(py, _mm256_round_pd(_mm256_mul_pd(_mm256_add_pd(y0, y1), half), toZero));
+    const __m256d r = _mm256_round_pd(_mm256_mul_pd(_mm256_sub_pd(x1, x0), half), toZero);
+    const __m256d distance = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    return unsigned(_mm256_movemask_pd(_mm256_cmp_pd(distance, _mm256_mul_pd(r, r), _CMP_LE_OQ)));
+}
+
+KERNEL_TARGET("avx2")
+int circlesContainingAvx2(const Boxes &b, const QPoint &p, int *out)
+{
+    const __m256d px = _mm256_set1_pd(p.x());
+    const __m256d py = _mm256_set1_pd(p.y());
+    int found = 0;
+    int i = 0;
+    for (; i + 4 <= b.count; i += 4)
+        found = appendMatches(circlesAvx2(b, i, px, py), i, out, found);
+    return circlesContainingScalar(b, i, p, out, found);
+}
+
+#endif // GEOMETRYKERNELS_X86
+
+Isa detectIsa()
+{
+#ifdef GEOMETRYKERNELS_X86
+    if (cpuSupports(Isa::Avx2))
+        return Isa::Avx2;
+    if (cpuSupports(Isa::Sse41))
+        return Isa::Sse41;
+#endif
+    return Isa::Scalar;
+}
+
+// -1 until the first kernel call detects the CPU
+QAtomicInteger<int> active(-1);
+
+} // namespace
+
+namespace GeometryKernels {
+
+Isa bestIsa()
+{
+    static const Isa best = detectIsa();
+    return best;
+}
+
+Isa activeIsa()
+{
+    const int isa = active.loadRelaxed();
+    if (isa >= 0)
+        return Isa(isa);
+    active.storeRelaxed(int(bestIsa()));
+    return bestIsa();
+}
+
+void setActiveIsa(Isa isa)
+{
+    active.storeRelaxed(int(std::min(isa, bestIsa())));
+}
+
+const char *isaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::Avx2:
+        return "avx2";
+    case Isa::Sse41:
+        return "sse4.1";
+    case Isa::Scalar:
+        break;
+    }
+    return "scalar";
+}
+
+QRect unite(const Boxes &boxes)
+{
+    if (boxes.count <= 0)
+        return QRect();
+
+    switch (activeIsa())
+    {
+#ifdef GEOMETRYKERNELS_X86
+    case Isa::Avx2:
+        return uniteAvx2(boxes);
+    case Isa::Sse41:
+        return uniteSse41(boxes);
+#endif
+    default:
+        break;
+    }
+    qint32 bounds[4] = {std::numeric_limits<qint32>::max(), std::numeric_limits<qint32>::max(),
+                        std::numeric_limits<qint32>::min(), std::numeric_limits<qint32>::min()};
+    return uniteScalar(boxes, 0, bounds);
+}
+
+void transform(const qint32 *x, const qint32 *y, int count, double scaleX, double dx, double scaleY, double dy,
+               double *outX, double *outY)
+{
+    switch (activeIsa())
+    {
+#ifdef GEOMETRYKERNELS_X86
+    case Isa::Avx2:
+        transformAvx2(x, y, count, scaleX, dx, scaleY, dy, outX, outY);
+        return;
+    case Isa::Sse41:
+        transformSse41(x, y, count, scaleX, dx, scaleY, dy, outX, outY);
+        return;
+#endif
+    default:
+        transformScalar(x, y, 0, count, scaleX, dx, scaleY, dy, outX, outY);
+        return;
+    }
+}
+
+int containing(const Boxes &boxes, const QPoint &point, int *out)
+{
+    switch (activeIsa())
+    {
+#ifdef GEOMETRYKERNELS_X86
+    case Isa::Avx2:
+        return containingAvx2(boxes, point, out);
+    case Isa::Sse41:
+        return containingSse41(boxes, point, out);
+#endif
+    default:
+        return containingScalar(boxes, 0, point, out, 0);
+    }
+}
+
+int intersecting(const Boxes &boxes, const QRect &area, int *out)
+{
+    if (area.isEmpty())
+        return 0;
+
+    switch (activeIsa())
+    {
+#ifdef GEOMETRYKERNELS_X86
+    case Isa::Avx2:
+        return intersectingAvx2(boxes, area, out);
+    case Isa::Sse41:
+        return intersectingSse41(boxes, area, out);
+#endif
+    default:
+        return intersectingScalar(boxes, 0, area, out, 0);
+    }
+}
+
+int circlesContaining(const Boxes &boxes, const QPoint &point, int *out)
+{
+    switch (activeIsa())
+    {
+#ifdef GEOMETRYKERNELS_X86
+    case Isa::Avx2:
+        return circlesContainingAvx2(boxes, point, out);
+    case Isa::Sse41:
+        return circlesContainingSse41(boxes, point, out);
+#endif
+    default:
+        return circlesContainingScalar(boxes, 0, point, out, 0);
+    }
+}
+
+} // namespace GeometryKernels
@@ -0,0 +1,73 @@
+#ifndef GEOMETRYKERNELS_H
+#define GEOMETRYKERNELS_H
+
+#include <QPoint>
+#include <QRect>
+
+#include <cmath>
+
+// Batch geometry over packed coordinate columns, the layout ShapeStore keeps
+// its bounding boxes in. Every kernel has a scalar version and, on x86, SSE4.1
+// and AVX2 versions; the widest one the CPU supports is picked at run time.
+// All versions give identical results, apart from transform(), which may
+// round differently where the compiler fuses multiply and add.
+namespace GeometryKernels {
+
+enum class Isa
+{
+    Scalar,
+    Sse41,
+    Avx2
+};
+
+// The widest instruction set this CPU supports, and the one in use. The
+// active set may be lowered, e.g. to compare against the scalar kernels;
+// requests beyond what the CPU supports are clamped.
+Isa bestIsa();
+Isa activeIsa();
+void setActiveIsa(Isa isa);
+const char *isaName(Isa isa);
+
+// count inclusive boxes, one column per edge
+struct Boxes
+{
+    const qint32 *minX = nullptr;
+    const qint32 *minY = nullptr;
+    const qint32 *maxX = nullptr;
+    const qint32 *maxY = nullptr;
+    int count = 0;
+};
+
+// Smallest box holding every box; an empty QRect when there are none
+QRect unite(const Boxes &boxes);
+
+// outX[i] = x[i] * scaleX + dx and outY[i] = y[i] * scaleY + dy, the
+// axis-aligned transforms between world and view
+void transform(const qint32 *x, const qint32 *y, int count, double scaleX, double dx, double scaleY, double dy,
+               double *outX, double *outY);
+
+// The following write the indices of the matching boxes to out, which needs
+// room for boxes.count entries, in ascending order and return how many
+// matched.
+
+// Boxes containing point, edges included (QRect::contains())
+int containing(const Boxes &boxes, const QPoint &point, int *out);
+// Boxes intersecting area, e.g. the visible part of the world (QRect::intersects())
+int intersecting(const Boxes &boxes, const QRect &area, int *out);
+// Circles containing point, each given by its bounding box as ShapeStore
+// keeps circles: center and radius rounded towards zero
+int circlesContaining(const Boxes &boxes, const QPoint &point, int *out);
+
+// The single-circle test all versions of circlesContaining() agree with.
+// Exact for coordinates below 2^25.
+inline bool circleContains(qint32 minX, qint32 minY, qint32 maxX, qint32 maxY, const QPoint &point)
+{
+    const double dx = point.x() - std::trunc((double(minX) + maxX) / 2);
+    const double dy = point.y() - std::trunc((double(minY) + maxY) / 2);
+    const double r = std::trunc((double(maxX) - minX) / 2);
+    return dx * dx + dy * dy <= r * r;
+}
+
+} // namespace GeometryKernels
+
+#endif // GEOMETRYKERNELS_H
@@ -0,0 +1,371 @@
+#include "geometryquery.h"
+#include "profiler.h"
+#include "spatialindex.h"
+#include "threadpool.h"
+
+#include <QRect>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+using GeometryQuery::Overlap;
+using GeometryQuery::Snap;
+
+// overlaps() cuts the scene into bands this many median boxes high, and
+// into at most maxBands of them
+constexpr int bandSpan = 4;
+constexpr int maxBands = 1 << 16;
+// Boxes crossing more bands than this are swept on their own, this many
+// to a task
+constexpr int maxBandsPerBox = 4;
+constexpr int tallChunkSize = 64;
+
+struct Box
+{
+    qint32 minX;
+    qint32 minY;
+    qint32 maxX;
+    qint32 maxY;
+    ShapeKind kind;
+};
+
+// A circle as ShapeStore keeps it, see GeometryKernels::circleContains()
+struct Disk
+{
+    double cx;
+    double cy;
+    double r;
+};
+
+// A box in sweep order: x runs along the sweep axis
+struct SweepItem
+{
+    Box box;
+    ShapeId id;
+};
+
+Box boxAt(const ShapeStore &shapes, int slot)
+{
+    return {shapes.minXAt(slot), shapes.minYAt(slot), shapes.maxXAt(slot), shapes.maxYAt(slot), shapes.kindAt(slot)};
+}
+
+Disk diskOf(const Box &box)
+{
+    return {std::trunc((double(box.minX) + box.maxX) / 2), std::trunc((double(box.minY) + box.maxY) / 2),
+            std::trunc((double(box.maxX) - box.minX) / 2)};
+}
+
+// A circle lies within its bounding box, so boxes that miss each other rule
+// out every pair of kinds. Symmetric in x and y, so it holds for swapped axes.
+bool shapesOverlap(const Box &a, const Box &b)
+{
+    if (a.minX > b.maxX || b.minX > a.maxX || a.minY > b.maxY || b.minY > a.maxY)
+        return false;
+    if (a.kind == ShapeKind::Rectangle && b.kind == ShapeKind::Rectangle)
+        return true;
+
+    if (a.kind == ShapeKind::Circle && b.kind == ShapeKind::Circle)
+    {
+        const Disk da = diskOf(a);
+        const Disk db = diskOf(b);
+        const double dx = da.cx - db.cx;
+        const double dy = da.cy - db.cy;
+        return dx * dx + dy * dy <= (da.r + db.r) * (da.r + db.r);
+    }
+
+    // Rectangle and circle: the rectangle point nearest the center
+    const Box &rect = a.kind == ShapeKind::Rectangle ? a : b;
+    const Disk disk = diskOf(a.kind == ShapeKind::Circle ? a : b);
+    const double dx = disk.cx - qBound<double>(rect.minX, disk.cx, rect.maxX);
+    const double dy = disk.cy - qBound<double>(rect.minY, disk.cy, rect.maxY);
+    return dx * dx + dy * dy <= disk.r * disk.r;
+}
+
+// The point of the shape's outline nearest to point
+QPointF nearestOutlinePoint(const Box &box, const QPointF &point)
+{
+    if (box.kind == ShapeKind::Circle)
+    {
+        const Disk disk = diskOf(box);
+        const double dx = point.x() - disk.cx;
+        const double dy = point.y() - disk.cy;
+        const double length = std::hypot(dx, dy);
+        if (length == 0)
+            return QPointF(disk.cx + disk.r, disk.cy);
+        return QPointF(disk.cx + dx * disk.r / length, disk.cy + dy * disk.r / length);
+    }
+
+    const QPointF clamped(qBound<qreal>(box.minX, point.x(), box.maxX), qBound<qreal>(box.minY, point.y(), box.maxY));
+    if (clamped != point)
+        return clamped;
+
+    // Inside: straight out through the nearest edge
+    const qreal toLeft = point.x() - box.minX;
+    const qreal toRight = box.maxX - point.x();
+    const qreal toBottom = point.y() - box.minY;
+    const qreal toTop = box.maxY - point.y();
+    const qreal nearest = std::min({toLeft, toRight, toBottom, toTop});
+    if (nearest == toLeft)
+        return QPointF(box.minX, point.y());
+    if (nearest == toRight)
+        return QPointF(box.maxX, point.y());
+    if (nearest == toBottom)
+        return QPointF(point.x(), box.minY);
+    return QPointF(point.x(), box.maxY);
+}
+
+// Ids of the shapes whose bounds come within maxDistance of point, ascending
+QVector<quint32> shapesInReach(const SpatialIndex &index, const QPointF &point, qreal maxDistance)
+{
+    QVector<quint32> candidates;
+    if (maxDistance >= 0)
+    {
+        index.query(QRect(QPoint(qFloor(point.x() - maxDistance), qFloor(point.y() - maxDistance)),
+                          QPoint(qCeil(point.x() + maxDistance), qCeil(point.y() + maxDistance))),
+                    candidates);
+    }
+    return candidates;
+}
+
+// Keeps candidate if it is nearer than best, or as near and (having a
+// larger id) higher up
+void consider(Snap &best, ShapeId id, const QPointF &candidate, const QPointF &point, qreal maxDistance)
+{
+    const qreal distance = std::hypot(candidate.x() - point.x(), candidate.y() - point.y());
+    if (distance <= maxDistance && (!best.isValid() || distance <= best.distance))
+        best = {id, candidate, distance};
+}
+
+} // namespace
+
+namespace GeometryQuery {
+
+QVector<Overlap> overlaps(const ShapeStore &shapes)
+{
+    PROFILE_SCOPE("overlaps");
+    const int count = shapes.size();
+    if (count < 2)
+        return {};
+
+    // Sweep along the longer side of the scene and cut the shorter side into
+    // bands; swapping x and y changes no overlap test
+    const QRect extent = shapes.extent();
+    const bool swapAxes = extent.height() > extent.width();
+    const qint32 crossStart = swapAxes ? extent.left() : extent.top();
+    const qint64 crossLength = swapAxes ? extent.width() : extent.height();
+
+    QVector<SweepItem> items(count);
+    SweepItem *itemData = items.data(); // detach once, before any worker runs
+    QVector<std::function<void()>> tasks;
+    for (int run = 0; run < shapes.runCount(); ++run)
+    {
+        tasks.append([&shapes, itemData, run, swapAxes] {
+            const GeometryKernels::Boxes boxes = shapes.boxRun(run);
+            const int from = run * ShapeStore::runLength;
+            for (int i = 0; i < boxes.count; ++i)
+            {
+                const ShapeKind kind = shapes.kindAt(from + i);
+                SweepItem &item = itemData[from + i];
+                item.box = swapAxes ? Box{boxes.minY[i], boxes.minX[i], boxes.maxY[i], boxes.maxX[i], kind}
+                                    : Box{boxes.minX[i], boxes.minY[i], boxes.maxX[i], boxes.maxY[i], kind};
+                item.id = shapes.idAt(from + i);
+            }
+        });
+    }
+    WorkStealingPool::global().run(tasks);
+
+    // Bands a few boxes high: each box is swept only against the boxes in
+    // the bands it crosses, and few boxes cross more than two bands. The
+    // median height sets the band height, which a few huge boxes do not move.
+    QVector<qint64> heights(count);
+    for (int i = 0; i < count; ++i)
+        heights[i] = qint64(items.at(i).box.maxY) - items.at(i).box.minY + 1;
+    std::nth_element(heights.begin(), heights.begin() + count / 2, heights.end());
+    const qint64 bandHeight = std::max<qint64>(
+        {1, bandSpan * heights.at(count / 2), (crossLength + maxBands - 1) / maxBands});
+    heights = QVector<qint64>();
+    const int bandCount = int((crossLength + bandHeight - 1) / bandHeight);
+    const auto bandOf = [crossStart, bandHeight](qint32 y) { return int((qint64(y) - crossStart) / bandHeight); };
+
+    // A box crossing many bands, such as a sheet frame, would be copied into
+    // every one of them; those go to the end of items and are swept apart
+    const auto crossesFewBands = [&bandOf](const SweepItem &item) {
+        return bandOf(item.box.maxY) - bandOf(item.box.minY) < maxBandsPerBox;
+    };
+    const int flatCount = int(std::partition(items.begin(), items.end(), crossesFewBands) - items.begin());
+    const int tallCount = count - flatCount;
+
+    // Counting sort of the flat boxes into their bands
+    QVector<int> bandStart(bandCount + 1, 0);
+    for (int i = 0; i < flatCount; ++i)
+    {
+        const SweepItem &item = items.at(i);
+        for (int band = bandOf(item.box.minY); band <= bandOf(item.box.maxY); ++band)
+            ++bandStart[band + 1];
+    }
+    for (int band = 0; band < bandCount; ++band)
+        bandStart[band + 1] += bandStart[band];
+    QVector<SweepItem> banded(bandStart.last());
+    QVector<int> fill = bandStart;
+    for (int i = 0; i < flatCount; ++i)
+    {
+        const SweepItem &item = items.at(i);
+        for (int band = bandOf(item.box.minY); band <= bandOf(item.box.maxY); ++band)
+            banded[fill[band]++] = item;
+    }
+    if (tallCount == 0)
+        items = QVector<SweepItem>();
+
+    // One task per band: sort by the low edge, then each box meets only the
+    // boxes starting within its span further on. A pair shows up in every
+    // band both boxes cross; only the band where their overlap starts
+    // reports it.
+    const int tallChunks = (tallCount + tallChunkSize - 1) / tallChunkSize;
+    const int flatChunks = tallCount > 0 ? (flatCount + ShapeStore::runLength - 1) / ShapeStore::runLength : 0;
+    QVector<QVector<Overlap>> found(bandCount + (tallCount > 0 ? 1 + tallChunks + flatChunks : 0));
+    QVector<Overlap> *foundData = found.data();
+    SweepItem *bandedData = banded.data();
+    tasks.clear();
+    for (int band = 0; band < bandCount; ++band)
+    {
+        const int from = bandStart.at(band);
+        const int to = bandStart.at(band + 1);
+        if (to - from < 2)
+            continue;
+        tasks.append([bandedData, foundData, band, from, to, bandOf] {
+            SweepItem *first = bandedData + from;
+            SweepItem *last = bandedData + to;
+            std::sort(first, last, [](const SweepItem &a, const SweepItem &b) { return a.box.minX < b.box.minX; });
+
+            QVector<Overlap> &pairs = foundData[band];
+            for (const SweepItem *a = first; a != last; ++a)
+            {
+                for (const SweepItem *b = a + 1; b != last && b->box.minX <= a->box.maxX; ++b)
+                {
+                    if (bandOf(std::max(a->box.minY, b->box.minY)) == band && shapesOverlap(a->box, b->box))
+                        pairs.append(Overlap{std::min(a->id, b->id), std::max(a->id, b->id)});
+                }
+            }
+        });
+    }
+
+    // Tall boxes in one sweep along x, with every box sorted by its low edge.
+    // Two boxes meet along x when one's low edge lies within the other's
+    // span, so each pair with a tall box is found exactly once: tall against
+    // tall as in a band, a tall box against the flat boxes starting in its
+    // span, and a flat box against the tall boxes starting after it within
+    // its own span.
+    if (tallCount > 0)
+    {
+        const auto byMinX = [](const SweepItem &a, const SweepItem &b) { return a.box.minX < b.box.minX; };
+        SweepItem *flat = items.data();
+        SweepItem *flatEnd = flat + flatCount;
+        SweepItem *tall = flatEnd;
+        SweepItem *tallEnd = tall + tallCount;
+        WorkStealingPool::global().run({[flat, flatEnd, byMinX] { std::sort(flat, flatEnd, byMinX); },
+                                        [tall, tallEnd, byMinX] { std::sort(tall, tallEnd, byMinX); }});
+
+        const auto report = [](QVector<Overlap> &pairs, const SweepItem &a, const SweepItem &b) {
+            if (shapesOverlap(a.box, b.box))
+                pairs.append(Overlap{std::min(a.id, b.id), std::max(a.id, b.id)});
+        };
+        QVector<Overlap> *tallFound = foundData + bandCount;
+        tasks.append([tall, tallEnd, tallFound, report] {
+            for (const SweepItem *a = tall; a != tallEnd; ++a)
+            {
+                for (const SweepItem *b = a + 1; b != tallEnd && b->box.minX <= a->box.maxX; ++b)
+                    report(*tallFound, *a, *b);
+            }
+        });
+        for (int chunk = 0; chunk < tallChunks; ++chunk)
+        {
+            const int from = chunk * tallChunkSize;
+            const int to = std::min(tallCount, from + tallChunkSize);
+            tasks.append([flat, flatEnd, tall, from, to, pairs = tallFound + 1 + chunk, byMinX, report] {
+                for (const SweepItem *a = tall + from; a != tall + to; ++a)
+                {
+                    for (const SweepItem *b = std::lower_bound(flat, flatEnd, *a, byMinX);
+                         b != flatEnd && b->box.minX <= a->box.maxX; ++b)
+                        report(*pairs, *a, *b);
+                }
+            });
+        }
+        for (int chunk = 0; chunk < flatChunks; ++chunk)
+        {
+            const int from = chunk * ShapeStore::runLength;
+            const int to = std::min(flatCount, from + ShapeStore::runLength);
+            tasks.append([flat, from, to, tall, tallEnd, pairs = tallFound + 1 + tallChunks + chunk, byMinX, report] {
+                for (const SweepItem *a = flat + from; a != flat + to; ++a)
+                {
+                    for (const SweepItem *b = std::upper_bound(tall, tallEnd, *a, byMinX);
+                         b != tallEnd && b->box.minX <= a->box.maxX; ++b)
+                        report(*pairs, *a, *b);
+                }
+            });
+        }
+    }
+    WorkStealingPool::global().run(tasks);
+
+    int total = 0;
+    for (const QVector<Overlap> &pairs : found)
+        total += pairs.size();
+    QVector<Overlap> result;
+    result.reserve(total);
+    for (const QVector<Overlap> &pairs : found)
+        result += pairs;
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool overlap(const ShapeStore &shapes, int a, int b)
+{
+    return shapesOverlap(boxAt(shapes, a), boxAt(shapes, b));
+}
+
+Snap nearestShape(const ShapeStore &shapes, const SpatialIndex &index, const QPointF &point, qreal maxDistance)
+{
+    Snap best;
+    for (quint32 id : shapesInReach(index, point, maxDistance))
+    {
+        const int slot = shapes.slotOf(id);
+        if (slot >= 0)
+            consider(best, id, nearestOutlinePoint(boxAt(shapes, slot), point), point, maxDistance);
+    }
+    return best;
+}
+
+Snap snapPoint(const ShapeStore &shapes, const SpatialIndex &index, const QPointF &point, qreal maxDistance)
+{
+    Snap best;
+    for (quint32 id : shapesInReach(index, point, maxDistance))
+    {
+        const int slot = shapes.slotOf(id);
+        if (slot < 0)
+            continue;
+
+        const Box box = boxAt(shapes, slot);
+        if (box.kind == ShapeKind::Rectangle)
+        {
+            consider(best, id, QPointF(box.minX, box.minY), point, maxDistance);
+            consider(best, id, QPointF(box.maxX, box.minY), point, maxDistance);
+            consider(best, id, QPointF(box.minX, box.maxY), point, maxDistance);
+            consider(best, id, QPointF(box.maxX, box.maxY), point, maxDistance);
+        }
+        else
+        {
+            const Disk disk = diskOf(box);
+            consider(best, id, QPointF(disk.cx, disk.cy), point, maxDistance);
+            consider(best, id, QPointF(disk.cx + disk.r, disk.cy), point, maxDistance);
+            consider(best, id, QPointF(disk.cx - disk.r, disk.cy), point, maxDistance);
+            consider(best, id, QPointF(disk.cx, disk.cy + disk.r), point, maxDistance);
+            consider(best, id, QPointF(disk.cx, disk.cy - disk.r), point, maxDistance);
+        }
+    }
+    return best.isValid() ? best : nearestShape(shapes, index, point, maxDistance);
+}
+
+} // namespace GeometryQuery
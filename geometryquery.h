@@ -0,0 +1,64 @@
+#ifndef GEOMETRYQUERY_H
+#define GEOMETRYQUERY_H
+
+#include <QPointF>
+#include <QVector>
+
+#include "shapestore.h"
+
+class SpatialIndex;
+
+// Exact geometric queries over the shapes: which shapes overlap (clash
+// detection) and which shape or snap point lies nearest to a point.
+// Rectangles are their bounding box, edges included, and circles the disk
+// ShapeStore keeps them as (see GeometryKernels::circleContains()). Shapes
+// that only touch count as overlapping. Results are exact for coordinates
+// below 2^25.
+namespace GeometryQuery {
+
+// Two overlapping shapes, a below b
+struct Overlap
+{
+    ShapeId a = InvalidShapeId;
+    ShapeId b = InvalidShapeId;
+
+    bool operator==(const Overlap &other) const { return a == other.a && b == other.b; }
+    bool operator<(const Overlap &other) const { return a < other.a || (a == other.a && b < other.b); }
+};
+
+// Every overlapping pair, sorted by a and then b. Sweep and prune: the scene
+// is cut into bands running along its longer side, each a few boxes deep,
+// and within each band the boxes are sorted by their low edge and each is
+// tested only against the boxes starting within its own span. Boxes that
+// cross more than a few bands, such as sheet frames, are not copied into
+// each band but swept along the whole scene against all boxes in one pass.
+// Bands are swept in parallel on the worker pool, so the cost follows the
+// shape count and the number of near pairs, not the square of the shape count.
+QVector<Overlap> overlaps(const ShapeStore &shapes);
+
+// Whether the shapes in slots a and b overlap
+bool overlap(const ShapeStore &shapes, int a, int b);
+
+// A point on or of a shape, and how far it lies from the query point
+struct Snap
+{
+    ShapeId id = InvalidShapeId;
+    QPointF point;
+    qreal distance = 0;
+
+    bool isValid() const { return id != InvalidShapeId; }
+};
+
+// The shape whose outline passes nearest to point, no farther than
+// maxDistance, and the nearest point of that outline. index must hold the
+// bounds of every shape, as Canvas keeps it. On a tie the topmost shape wins.
+Snap nearestShape(const ShapeStore &shapes, const SpatialIndex &index, const QPointF &point, qreal maxDistance);
+
+// Where point snaps to: the nearest rectangle corner, circle center or
+// circle quadrant point within maxDistance; failing that, the nearest
+// outline point as nearestShape() finds it. Invalid if neither is in reach.
+Snap snapPoint(const ShapeStore &shapes, const SpatialIndex &index, const QPointF &point, qreal maxDistance);
+
+} // namespace GeometryQuery
+
+#endif // GEOMETRYQUERY_H
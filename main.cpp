@@ -1,11 +1,261 @@
 #include "mainwindow.h"
+#include "batchrenderer.h"
+#include "csvimporter.h"
+#include "profiler.h"
+#include "sceneio.h"
+#include "scenegenerator.h"
+#include "scenejournal.h"
+#include "shapestore.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QTextStream>
+
+#include <cstdio>
+
+namespace {
+
+bool hasArgument(int argc, char *argv[], const char *argument)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (qstrcmp(argv[i], argument) == 0)
+            return true;
+    }
+    return false;
+}
+
+// The argument following argument, or an empty string
+QString argumentValue(int argc, char *argv[], const char *argument)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (qstrcmp(argv[i], argument) == 0)
+            return QString::fromLocal8Bit(argv[i + 1]);
+    }
+    return QString();
+}
+
+// No display needed unless the caller picked a platform explicitly
+void preferOffscreenPlatform(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") && !hasArgument(argc, argv, "-platform"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+}
+
+// VibeCad --convert scene.json scene.vcb
+int runConvert(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Rewrites a scene in the format implied by the target suffix.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("convert", "Convert a scene file."));
+    parser.addPositionalArgument("source", "Scene file to read.");
+    parser.addPositionalArgument("target", "Scene file to write (.vcb for binary, otherwise JSON).");
+    parser.process(a);
+
+    const QStringList files = parser.positionalArguments();
+    if (files.size() != 2)
+        parser.showHelp(2);
+    return SceneIO::convert(files.at(0), files.at(1)) ? 0 : 1;
+}
+
+// VibeCad --headless [--format png|pdf] [--dpi N] [--output-dir DIR] [--max-pages N] scene...
+int runHeadless(int argc, char *argv[])
+{
+    preferOffscreenPlatform(argc, argv);
+    QGuiApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders scene files to PNG or PDF at 1 px = 1 mm on A4 landscape pages.");
+    parser.addHelpOption();
+    const QCommandLineOption headlessOption("headless", "Render without a window.");
+    const QCommandLineOption formatOption({"f", "format"}, "Output format: png or pdf.", "format", "png");
+    const QCommandLineOption dpiOption("dpi", "Output resolution in dots per inch.", "dpi", "300");
+    const QCommandLineOption outputOption({"o", "output-dir"}, "Directory for the output files (default: next to each input).", "dir");
+    const QCommandLineOption sizeOption("canvas-size", "Canvas size in mm as WxH (default: fit the scene).", "size");
+    const QCommandLineOption maxPagesOption("max-pages", "Fail scenes that need more pages than this.", "n", "1000");
+    const QCommandLineOption noLodOption("no-lod", "Draw every shape at full detail.");
+    const QCommandLineOption zOrderOption("exact-z-order", "Keep the z-order between shapes of different styles.");
+    parser.addOption(headlessOption);
+    parser.addOption(formatOption);
+    parser.addOption(dpiOption);
+    parser.addOption(outputOption);
+    parser.addOption(sizeOption);
+    parser.addOption(maxPagesOption);
+    parser.addOption(noLodOption);
+    parser.addOption(zOrderOption);
+    parser.addPositionalArgument("scenes", "Scene files to render (.json or .vcb).", "scene...");
+    parser.process(a);
+
+    QTextStream err(stderr);
+    BatchRenderer::Options options;
+    options.outputDir = parser.value(outputOption);
+    options.lod.enabled = !parser.isSet(noLodOption);
+    options.lod.groupStyles = !parser.isSet(zOrderOption);
+
+    const QString format = parser.value(formatOption).toLower();
+    if (format == "pdf")
+        options.format = BatchRenderer::Format::Pdf;
+    else if (format != "png")
+    {
+        err << "Unknown format: " << format << "\n";
+        return 2;
+    }
+
+    bool ok = false;
+    options.dpi = parser.value(dpiOption).toInt(&ok);
+    if (!ok || options.dpi <= 0)
+    {
+        err << "Invalid DPI: " << parser.value(dpiOption) << "\n";
+        return 2;
+    }
+
+    options.maxPages = parser.value(maxPagesOption).toInt(&ok);
+    if (!ok || options.maxPages <= 0)
+    {
+        err << "Invalid page limit: " << parser.value(maxPagesOption) << "\n";
+        return 2;
+    }
+
+    if (parser.isSet(sizeOption))
+    {
+        const QStringList parts = parser.value(sizeOption).split('x');
+        bool okW = false, okH = false;
+        if (parts.size() == 2)
+            options.canvasSize = QSize(parts.at(0).toInt(&okW), parts.at(1).toInt(&okH));
+        if (!okW || !okH || options.canvasSize.isEmpty())
+        {
+            err << "Invalid canvas size: " << parser.value(sizeOption) << "\n";
+            return 2;
+        }
+    }
+
+    const QStringList inputs = parser.positionalArguments();
+    if (inputs.isEmpty())
+        parser.showHelp(2);
+
+    QStringList errors;
+    const BatchRenderer::Stats stats = BatchRenderer::run(inputs, options, &errors);
+    for (const QString &error : errors)
+        err << error << "\n";
+
+    const double seconds = qMax<qint64>(stats.elapsedMs, 1) / 1000.0;
+    QTextStream out(stdout);
+    out << QString("Rendered %1 of %2 files (%3 pages, %4 shapes) in %5 s: %6 files/s, %7 shapes/s\n")
+               .arg(stats.files - stats.failed)
+               .arg(stats.files)
+               .arg(stats.pages)
+               .arg(stats.shapes)
+               .arg(seconds, 0, 'f', 3)
+               .arg((stats.files - stats.failed) / seconds, 0, 'f', 1)
+               .arg(stats.shapes / seconds, 0, 'f', 0);
+    return stats.failed == 0 ? 0 : 1;
+}
+
+// VibeCad --generate COUNT scene.vcb [--seed N]
+int runGenerate(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Writes a synthetic scene of alternating rectangles and circles.");
+    parser.addHelpOption();
+    const QCommandLineOption seedOption("seed", "Random seed.", "seed", "1");
+    parser.addOption(QCommandLineOption("generate", "Generate a scene file."));
+    parser.addOption(seedOption);
+    parser.addPositionalArgument("count", "Number of shapes.");
+    parser.addPositionalArgument("target", "Scene file to write (.vcb for binary, otherwise JSON).");
+    parser.process(a);
+
+    const QStringList arguments = parser.positionalArguments();
+    bool okCount = false, okSeed = false;
+    const int count = arguments.value(0).toInt(&okCount);
+    const quint32 seed = parser.value(seedOption).toUInt(&okSeed);
+    if (arguments.size() != 2 || !okCount || count < 0 || !okSeed)
+        parser.showHelp(2);
+
+    ShapeStore shapes;
+    SceneGenerator::generate(shapes, count, SceneGenerator::sideForCount(count), seed);
+    return SceneIO::save(arguments.at(1), shapes) ? 0 : 1;
+}
+
+// VibeCad --import shapes.csv scene.vcb, or - to read standard input
+int runImport(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Appends the shapes listed in a CSV file to a scene.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("import", "Import shapes into a scene file."));
+    parser.addPositionalArgument("source", "CSV file to read, or - for standard input.");
+    parser.addPositionalArgument("target", "Scene file to extend; created if missing.");
+    parser.process(a);
+
+    const QStringList files = parser.positionalArguments();
+    if (files.size() != 2)
+        parser.showHelp(2);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<ShapeSpec> specs;
+    QString error;
+    if (!CsvImporter::read(files.at(0), specs, &error))
+    {
+        QTextStream(stderr) << files.at(0) << ": " << error << "\n";
+        return 1;
+    }
+    const qint64 parseMs = timer.elapsed();
+
+    // Journaled edits are folded in, so none are lost with the new snapshot
+    ShapeStore shapes;
+    if (QFile::exists(files.at(1)) && !SceneJournal::recover(files.at(1), shapes, nullptr, nullptr))
+    {
+        QTextStream(stderr) << files.at(1) << ": not a scene file\n";
+        return 1;
+    }
+    shapes.addShapes(specs.constData(), specs.size());
+    if (!SceneIO::save(files.at(1), shapes))
+        return 1;
+
+    const double parseSeconds = qMax<qint64>(parseMs, 1) / 1000.0;
+    QTextStream(stdout) << QString("Imported %1 shapes in %2 s (parsed at %3 rows/s)\n")
+                               .arg(specs.size())
+                               .arg(timer.elapsed() / 1000.0, 0, 'f', 3)
+                               .arg(specs.size() / parseSeconds, 0, 'f', 0);
+    return 0;
+}
+
+} // namespace
 
 int main(int argc, char *argv[])
 {
+    // Modes without a GUI are picked before any application object exists,
+    // since the headless mode has to choose its platform plugin first
+    if (hasArgument(argc, argv, "--convert"))
+        return runConvert(argc, argv);
+    if (hasArgument(argc, argv, "--headless"))
+        return runHeadless(argc, argv);
+    if (hasArgument(argc, argv, "--generate"))
+        return runGenerate(argc, argv);
+    if (hasArgument(argc, argv, "--import"))
+        return runImport(argc, argv);
+
+    // VibeCad [--profile] [--trace session.json]: profiles from the start,
+    // and with --trace saves the session's trace on exit
+    const QString tracePath = argumentValue(argc, argv, "--trace");
+    if (hasArgument(argc, argv, "--profile") || !tracePath.isEmpty())
+        Profiler::setEnabled(true);
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
-    return a.exec();
+    const int result = a.exec();
+    if (!tracePath.isEmpty() && !Profiler::writeTrace(tracePath))
+        QTextStream(stderr) << "Could not write " << tracePath << "\n";
+    return result;
 }
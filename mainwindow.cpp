@@ -1,22 +1,34 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "canvas.h"
+#include "csvimporter.h"
+#include "pagepipeline.h"
+#include "profiler.h"
 
+#include <QAction>
 #include <QCoreApplication>
 #include <QDialog>
 #include <QDialogButtonBox>
+#include <QFileDialog>
 #include <QFormLayout>
+#include <QFutureWatcher>
 #include <QHBoxLayout>
+#include <QLabel>
 #include <QtMath>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QPainter>
+#include <QPicture>
 #include <QPageLayout>
 #include <QPageSize>
 #include <QMarginsF>
 #include <QPrintDialog>
 #include <QPrinter>
+#include <QProgressBar>
 #include <QPushButton>
+#include <QStatusBar>
+#include <QTimer>
+#include <QUndoStack>
 #include <QVBoxLayout>
 #include <QCloseEvent>
 #include <algorithm>
@@ -37,11 +49,24 @@ MainWindow::MainWindow(QWidget *parent)
     addRectButton = new QPushButton(tr("Add Rectangle"), this);
     addCircleButton = new QPushButton(tr("Add Circle"), this);
     deleteButton = new QPushButton(tr("Delete Selected"), this);
+    importButton = new QPushButton(tr("Import CSV..."), this);
+    overlapsButton = new QPushButton(tr("Find Overlaps"), this);
+    snapButton = new QPushButton(tr("Snap"), this);
+    snapButton->setCheckable(true);
+    undoButton = new QPushButton(tr("Undo"), this);
+    redoButton = new QPushButton(tr("Redo"), this);
+    fitButton = new QPushButton(tr("Fit"), this);
     printButton = new QPushButton(tr("Print"), this);
     toolbar->addWidget(addRectButton);
     toolbar->addWidget(addCircleButton);
     toolbar->addWidget(deleteButton);
+    toolbar->addWidget(importButton);
+    toolbar->addWidget(overlapsButton);
+    toolbar->addWidget(snapButton);
+    toolbar->addWidget(undoButton);
+    toolbar->addWidget(redoButton);
     toolbar->addStretch();
+    toolbar->addWidget(fitButton);
     toolbar->addWidget(printButton);
     layout->addLayout(toolbar);
 
@@ -50,10 +75,101 @@ MainWindow::MainWindow(QWidget *parent)
     connect(addRectButton, &QPushButton::clicked, this, &MainWindow::addRectangle);
     connect(addCircleButton, &QPushButton::clicked, this, &MainWindow::addCircle);
     connect(deleteButton, &QPushButton::clicked, this, &MainWindow::deleteSelected);
+    connect(importButton, &QPushButton::clicked, this, &MainWindow::importShapes);
+    connect(overlapsButton, &QPushButton::clicked, this, &MainWindow::findOverlaps);
+    connect(snapButton, &QPushButton::toggled, canvas, &Canvas::setSnapping);
     connect(printButton, &QPushButton::clicked, this, &MainWindow::printCanvas);
-
-    sceneFilePath = QCoreApplication::applicationDirPath() + "/scene.json";
-    canvas->loadFromFile(sceneFilePath);
+    connect(fitButton, &QPushButton::clicked, canvas, &Canvas::fitToScene);
+
+    QUndoStack *undoStack = canvas->undoStack();
+    undoButton->setEnabled(false);
+    redoButton->setEnabled(false);
+    connect(undoButton, &QPushButton::clicked, undoStack, &QUndoStack::undo);
+    connect(redoButton, &QPushButton::clicked, undoStack, &QUndoStack::redo);
+    connect(undoStack, &QUndoStack::canUndoChanged, undoButton, &QPushButton::setEnabled);
+    connect(undoStack, &QUndoStack::canRedoChanged, redoButton, &QPushButton::setEnabled);
+
+    // Window-wide shortcuts; the actions also follow the stack's state
+    QAction *undoAction = undoStack->createUndoAction(this, tr("Undo"));
+    QAction *redoAction = undoStack->createRedoAction(this, tr("Redo"));
+    undoAction->setShortcut(QKeySequence::Undo);
+    redoAction->setShortcut(QKeySequence::Redo);
+    addAction(undoAction);
+    addAction(redoAction);
+
+    QAction *zoomInAction = new QAction(tr("Zoom In"), this);
+    QAction *zoomOutAction = new QAction(tr("Zoom Out"), this);
+    QAction *actualSizeAction = new QAction(tr("Actual Size"), this);
+    zoomInAction->setShortcut(QKeySequence::ZoomIn);
+    zoomOutAction->setShortcut(QKeySequence::ZoomOut);
+    actualSizeAction->setShortcut(QKeySequence(tr("Ctrl+0")));
+    connect(zoomInAction, &QAction::triggered, canvas, [this] { canvas->zoomBy(1.25); });
+    connect(zoomOutAction, &QAction::triggered, canvas, [this] { canvas->zoomBy(0.8); });
+    connect(actualSizeAction, &QAction::triggered, canvas, &Canvas::resetView);
+    addAction(zoomInAction);
+    addAction(zoomOutAction);
+    addAction(actualSizeAction);
+
+    // F3 toggles object snapping, as in most CAD programs; the status bar
+    // shows the point the cursor snaps to, and the add dialogs start there
+    QAction *overlapsAction = new QAction(tr("Find Overlaps"), this);
+    QAction *snapAction = new QAction(tr("Snap"), this);
+    overlapsAction->setShortcut(QKeySequence(tr("Ctrl+Shift+O")));
+    snapAction->setShortcut(QKeySequence(tr("F3")));
+    connect(overlapsAction, &QAction::triggered, this, &MainWindow::findOverlaps);
+    connect(snapAction, &QAction::triggered, snapButton, &QPushButton::toggle);
+    connect(canvas, &Canvas::snapChanged, this, [this](const GeometryQuery::Snap &snap) {
+        if (snap.isValid())
+            statusBar()->showMessage(tr("Snap: %1, %2").arg(snap.point.x()).arg(snap.point.y()));
+        else
+            statusBar()->clearMessage();
+    });
+    addAction(overlapsAction);
+    addAction(snapAction);
+
+    // Profiling probes run only while the statistics are shown; F12 toggles
+    // them and Ctrl+Shift+T saves the session as a Chrome trace
+    statsLabel = new QLabel(this);
+    statsLabel->hide();
+    statusBar()->addPermanentWidget(statsLabel);
+    statsTimer = new QTimer(this);
+    statsTimer->setInterval(500);
+    connect(statsTimer, &QTimer::timeout, this, &MainWindow::updateStats);
+
+    QAction *statsAction = new QAction(tr("Show Statistics"), this);
+    QAction *traceAction = new QAction(tr("Save Trace..."), this);
+    statsAction->setCheckable(true);
+    statsAction->setShortcut(QKeySequence(tr("F12")));
+    traceAction->setShortcut(QKeySequence(tr("Ctrl+Shift+T")));
+    connect(statsAction, &QAction::toggled, this, &MainWindow::showStats);
+    connect(traceAction, &QAction::triggered, this, &MainWindow::saveTrace);
+    addAction(statsAction);
+    addAction(traceAction);
+    statsAction->setChecked(Profiler::isEnabled());
+
+    // Scene I/O runs in the background; the status bar shows its progress
+    ioProgress = new QProgressBar(this);
+    ioProgress->setRange(0, 1000);
+    ioProgress->setMaximumWidth(200);
+    ioProgress->hide();
+    cancelIoButton = new QPushButton(tr("Cancel"), this);
+    cancelIoButton->hide();
+    statusBar()->addPermanentWidget(ioProgress);
+    statusBar()->addPermanentWidget(cancelIoButton);
+    connect(cancelIoButton, &QPushButton::clicked, this, &MainWindow::cancelIo);
+
+    saveWatcher = new QFutureWatcher<bool>(this);
+    connect(saveWatcher, &QFutureWatcherBase::progressValueChanged, ioProgress, &QProgressBar::setValue);
+    connect(saveWatcher, &QFutureWatcherBase::finished, this, &MainWindow::sceneSaved);
+    connect(canvas, &Canvas::loadProgress, ioProgress, &QProgressBar::setValue);
+    connect(canvas, &Canvas::loadFinished, this, &MainWindow::sceneLoaded);
+    connect(canvas, &Canvas::journalFailed, this, [this](const QString &path) {
+        QMessageBox::warning(this, tr("Journal failed"),
+                             tr("Edits can no longer be logged next to %1. Save the scene to keep them.").arg(path));
+    });
+
+    sceneFilePath = QCoreApplication::applicationDirPath() + "/scene.vcb";
+    loadScene(sceneFilePath);
 }
 
 MainWindow::~MainWindow()
@@ -74,6 +190,7 @@ void MainWindow::printCanvas()
     QPrintDialog dlg(&printer, this);
     if (dlg.exec() != QDialog::Accepted)
         return;
+    PROFILE_SCOPE("print", Profiler::Metric::PrintMs);
     if (!printer.isValid())
     {
         QMessageBox::warning(this, tr("Print failed"), tr("No valid printer selected."));
@@ -95,11 +212,10 @@ void MainWindow::printCanvas()
         return;
     }
 
-    const qreal targetW = canvas->width() * scaleX;
-    const qreal targetH = canvas->height() * scaleY;
-
-    const int cols = std::max(1, qCeil(targetW / pageRect.width()));
-    const int rows = std::max(1, qCeil(targetH / pageRect.height()));
+    // Pages in widget pixels; each page draws only the shapes on it
+    const PagePipeline::Grid grid =
+        PagePipeline::grid(canvas->size(), QSizeF(pageRect.width() / scaleX, pageRect.height() / scaleY));
+    const QVector<QVector<ShapeId>> shapesOnPage = canvas->partitionPages(grid);
 
     QPainter painter;
     if (!painter.begin(&printer))
@@ -108,24 +224,56 @@ void MainWindow::printCanvas()
         return;
     }
 
-    for (int row = 0; row < rows; ++row)
-    {
-        for (int col = 0; col < cols; ++col)
-        {
-            painter.save();
-            const qreal tx = pageRect.x() - col * pageRect.width();
-            const qreal ty = pageRect.y() - row * pageRect.height();
-            painter.translate(tx, ty);
-            painter.scale(scaleX, scaleY);
-            canvas->render(&painter);
-            painter.restore();
+    const QRectF canvasRect(canvas->rect());
+    const auto paintPage = [&](int page, QPainter &pagePainter) {
+        pagePainter.scale(scaleX, scaleY);
+        pagePainter.translate(-grid.pageRect(page).topLeft());
+        pagePainter.setClipRect(grid.pageRect(page).intersected(canvasRect));
+        canvas->renderScene(pagePainter, shapesOnPage.at(page));
+    };
 
-            if (!(row == rows - 1 && col == cols - 1))
-                printer.newPage();
-        }
+    bool ok = false;
+    if (printer.outputFormat() == QPrinter::NativeFormat)
+    {
+        // A printer rasterizes anyway, so pages are rasterized here, in
+        // parallel, and only the finished images go to the device. Above
+        // 300 dpi an A4 page image gets too large to hold several at once.
+        const qreal imageScale = qMin<qreal>(1, 300.0 / printer.resolution());
+        const QSize imagePixels(qCeil(pageRect.width() * imageScale), qCeil(pageRect.height() * imageScale));
+        ok = PagePipeline::renderImages(
+            grid.count(), imagePixels,
+            [&](int page, QPainter &pagePainter) {
+                pagePainter.scale(imageScale, imageScale);
+                paintPage(page, pagePainter);
+            },
+            [&](int page, const QImage &image) {
+                if (page > 0 && !printer.newPage())
+                    return false;
+                painter.drawImage(pageRect, image);
+                return true;
+            });
+    }
+    else
+    {
+        // PDF output stays vector: pages are recorded in parallel, but the
+        // PDF engine encodes them in drawPicture(), serially on this thread
+        ok = PagePipeline::recordPictures(
+            grid.count(),
+            [&](int page, QPainter &pagePainter) {
+                pagePainter.translate(pageRect.topLeft());
+                paintPage(page, pagePainter);
+            },
+            [&](int page, const QPicture &picture) {
+                if (page > 0 && !printer.newPage())
+                    return false;
+                painter.drawPicture(0, 0, picture);
+                return true;
+            });
     }
 
     painter.end();
+    if (!ok)
+        QMessageBox::warning(this, tr("Print failed"), tr("Could not send every page to the printer."));
 }
 
 void MainWindow::addRectangle()
@@ -145,6 +293,12 @@ void MainWindow::addRectangle()
     blY->setPlaceholderText(tr("e.g. 180"));
     trX->setPlaceholderText(tr("e.g. 220"));
     trY->setPlaceholderText(tr("e.g. 40"));
+    if (canvas->currentSnap().isValid())
+    {
+        const QPoint snapped = canvas->currentSnap().point.toPoint();
+        blX->setText(QString::number(snapped.x()));
+        blY->setText(QString::number(snapped.y()));
+    }
     form->addRow(tr("Bottom-left X:"), blX);
     form->addRow(tr("Bottom-left Y:"), blY);
     form->addRow(tr("Top-right X:"), trX);
@@ -184,6 +338,12 @@ void MainWindow::addCircle()
     cx->setPlaceholderText(tr("e.g. 120"));
     cy->setPlaceholderText(tr("e.g. 80"));
     r->setPlaceholderText(tr("e.g. 40"));
+    if (canvas->currentSnap().isValid())
+    {
+        const QPoint snapped = canvas->currentSnap().point.toPoint();
+        cx->setText(QString::number(snapped.x()));
+        cy->setText(QString::number(snapped.y()));
+    }
     form->addRow(tr("Center X:"), cx);
     form->addRow(tr("Center Y:"), cy);
     form->addRow(tr("Radius:"), r);
@@ -206,11 +366,185 @@ void MainWindow::addCircle()
     canvas->addCircle(QPoint(centerX, centerY), radius);
 }
 
+void MainWindow::findOverlaps()
+{
+    if (!canvas)
+        return;
+
+    const int pairs = canvas->selectOverlapping();
+    if (pairs == 0)
+        statusBar()->showMessage(tr("No overlapping shapes"), 5000);
+    else
+        statusBar()->showMessage(tr("%1 overlapping pairs; %2 shapes selected")
+                                     .arg(pairs)
+                                     .arg(canvas->selectedShapes().size()),
+                                 5000);
+}
+
+void MainWindow::importShapes()
+{
+    if (!canvas)
+        return;
+
+    const QString path = QFileDialog::getOpenFileName(this, tr("Import Shapes"), QString(),
+                                                      tr("CSV files (*.csv *.txt);;All files (*)"));
+    if (path.isEmpty())
+        return;
+
+    QVector<ShapeSpec> shapes;
+    QString error;
+    if (!CsvImporter::read(path, shapes, &error))
+    {
+        QMessageBox::warning(this, tr("Import failed"), tr("Could not import %1: %2").arg(path, error));
+        return;
+    }
+
+    canvas->addShapes(shapes);
+    statusBar()->showMessage(tr("Imported %1 shapes").arg(shapes.size()), 5000);
+}
+
+void MainWindow::showStats(bool show)
+{
+    Profiler::setEnabled(show);
+    statsLabel->setVisible(show);
+    if (show)
+    {
+        updateStats();
+        statsTimer->start();
+    }
+    else
+    {
+        statsTimer->stop();
+    }
+}
+
+void MainWindow::updateStats()
+{
+    using Profiler::Metric;
+    QStringList parts;
+    const Profiler::Summary frame = Profiler::summary(Metric::FrameMs);
+    if (frame.samples > 0)
+        parts.append(tr("frame %1 ms (p95 %2)").arg(frame.median, 0, 'f', 1).arg(frame.p95, 0, 'f', 1));
+    const Profiler::Summary hits = Profiler::summary(Metric::TileHitRate);
+    if (hits.samples > 0)
+        parts.append(tr("tiles %1% cached").arg(hits.mean, 0, 'f', 0));
+    const Profiler::Summary drawn = Profiler::summary(Metric::ShapesDrawn);
+    if (drawn.samples > 0)
+        parts.append(tr("drawn %1, culled %2")
+                         .arg(qint64(drawn.last))
+                         .arg(qint64(Profiler::summary(Metric::ShapesCulled).last)));
+    const Profiler::Summary load = Profiler::summary(Metric::LoadMBps);
+    if (load.samples > 0)
+        parts.append(tr("load %1 MB/s").arg(load.last, 0, 'f', 0));
+    const Profiler::Summary save = Profiler::summary(Metric::SaveMBps);
+    if (save.samples > 0)
+        parts.append(tr("save %1 MB/s").arg(save.last, 0, 'f', 0));
+
+    statsLabel->setText(parts.isEmpty() ? tr("No samples yet") : parts.join("  |  "));
+    statsLabel->setToolTip(Profiler::report());
+}
+
+void MainWindow::saveTrace()
+{
+    const QString path = QFileDialog::getSaveFileName(this, tr("Save Trace"), QString("trace.json"),
+                                                      tr("Chrome trace files (*.json)"));
+    if (path.isEmpty())
+        return;
+    if (!Profiler::writeTrace(path))
+        QMessageBox::warning(this, tr("Save failed"), tr("Could not write %1.").arg(path));
+    else
+        statusBar()->showMessage(tr("Trace saved to %1").arg(path), 5000);
+}
+
+void MainWindow::loadScene(const QString &path)
+{
+    setBusy(true, tr("Loading %1...").arg(path));
+    canvas->loadFromFileAsync(path);
+}
+
+void MainWindow::sceneLoaded(bool ok, bool cancelled)
+{
+    if (!ok && cancelled)
+    {
+        // Whatever is shown now is not the scene on disk
+        keepSceneFile = true;
+        setBusy(false);
+        statusBar()->showMessage(tr("Loading cancelled; the scene will not be saved"));
+        return;
+    }
+    if (!ok && !triedJsonScene)
+    {
+        triedJsonScene = true;
+        loadScene(QCoreApplication::applicationDirPath() + "/scene.json"); // pre-binary scenes
+        return;
+    }
+
+    setBusy(false);
+    if (!canvas->startJournal(sceneFilePath))
+        statusBar()->showMessage(tr("Could not start the journal for %1; edits are kept only when saved")
+                                     .arg(sceneFilePath));
+}
+
+void MainWindow::sceneSaved()
+{
+    setBusy(false);
+    if (saveWatcher->isCanceled())
+        return; // closing was cancelled
+    if (saveWatcher->future().resultCount() == 0 || !saveWatcher->result())
+    {
+        QMessageBox::warning(this, tr("Save failed"), tr("Could not save %1.").arg(sceneFilePath));
+        return;
+    }
+
+    saved = true;
+    close();
+}
+
+void MainWindow::cancelIo()
+{
+    if (canvas->isLoading())
+        canvas->cancelLoad();
+    else
+        saveWatcher->cancel();
+}
+
+void MainWindow::setBusy(bool busy, const QString &message)
+{
+    addRectButton->setEnabled(!busy);
+    addCircleButton->setEnabled(!busy);
+    deleteButton->setEnabled(!busy);
+    importButton->setEnabled(!busy);
+    ioProgress->setValue(0);
+    ioProgress->setVisible(busy);
+    cancelIoButton->setVisible(busy);
+    if (busy)
+        statusBar()->showMessage(message);
+    else
+        statusBar()->clearMessage();
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
-    if (canvas)
-        canvas->saveToFile(sceneFilePath);
-    QMainWindow::closeEvent(event);
+    if (canvas->isLoading())
+    {
+        // A partly loaded scene must not replace the one on disk; the
+        // canvas waits for the loader as it goes
+        canvas->cancelLoad();
+        QMainWindow::closeEvent(event);
+        return;
+    }
+    if (saved || keepSceneFile)
+    {
+        QMainWindow::closeEvent(event);
+        return;
+    }
+
+    // Close once the save has finished
+    event->ignore();
+    if (saveWatcher->isRunning())
+        return;
+    setBusy(true, tr("Saving %1...").arg(sceneFilePath));
+    saveWatcher->setFuture(canvas->saveToFileAsync(sceneFilePath));
 }
 
 void MainWindow::deleteSelected()
@@ -6,7 +6,11 @@
 #include <QString>
 
 class Canvas;
+class QLabel;
+class QProgressBar;
 class QPushButton;
+class QTimer;
+template<typename T> class QFutureWatcher;
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -27,6 +31,14 @@ private slots:
     void addRectangle();
     void addCircle();
     void deleteSelected();
+    void findOverlaps();
+    void importShapes();
+    void sceneLoaded(bool ok, bool cancelled);
+    void sceneSaved();
+    void cancelIo();
+    void showStats(bool show);
+    void updateStats();
+    void saveTrace();
 
 protected:
     void closeEvent(QCloseEvent *event) override;
@@ -38,6 +50,24 @@ private:
     QPushButton *addRectButton = nullptr;
     QPushButton *addCircleButton = nullptr;
     QPushButton *deleteButton = nullptr;
+    QPushButton *importButton = nullptr;
+    QPushButton *overlapsButton = nullptr;
+    QPushButton *snapButton = nullptr;
+    QPushButton *fitButton = nullptr;
+    QPushButton *undoButton = nullptr;
+    QPushButton *redoButton = nullptr;
+    QProgressBar *ioProgress = nullptr;
+    QPushButton *cancelIoButton = nullptr;
+    QLabel *statsLabel = nullptr;
+    QTimer *statsTimer = nullptr;
     QString sceneFilePath;
+
+    void loadScene(const QString &path);
+    void setBusy(bool busy, const QString &message = QString());
+
+    QFutureWatcher<bool> *saveWatcher = nullptr;
+    bool triedJsonScene = false;
+    bool keepSceneFile = false; // loading was cancelled; do not overwrite the file
+    bool saved = false;
 };
 #endif // MAINWINDOW_H
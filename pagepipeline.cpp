@@ -0,0 +1,218 @@
+#include "pagepipeline.h"
+#include "geometrykernels.h"
+#include "profiler.h"
+#include "threadpool.h"
+#include "tilerasterizer.h"
+
+#include <QPainter>
+#include <QtMath>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+// Pages rendered in parallel, counted across every renderImages() and
+// recordPictures() call in the process, nested ones included: enough to
+// keep every pool thread and one caller busy
+std::atomic<int> pagesInFlight{0};
+
+int pageBudget()
+{
+    return WorkStealingPool::global().threadCount() + 1;
+}
+
+// Takes up to wanted pages of the budget and returns how many it got, which
+// is 0 while other calls hold all of it
+int reservePages(int wanted)
+{
+    int inFlight = pagesInFlight.load();
+    int granted = 0;
+    do
+    {
+        granted = std::min(wanted, pageBudget() - inFlight);
+        if (granted <= 0)
+            return 0;
+    } while (!pagesInFlight.compare_exchange_weak(inFlight, inFlight + granted));
+    return granted;
+}
+
+// Holds the pages reserved for one batch until they are written
+class PageReservation
+{
+public:
+    explicit PageReservation(int wanted)
+        : reserved(reservePages(wanted))
+    {
+    }
+    ~PageReservation() { pagesInFlight -= reserved; }
+
+    PageReservation(const PageReservation &) = delete;
+    PageReservation &operator=(const PageReservation &) = delete;
+
+    // Pages to render now: what the budget gave, or a single page rendered
+    // on the calling thread when it gave none
+    int pages() const { return std::max(reserved, 1); }
+    bool parallel() const { return reserved > 0; }
+
+private:
+    const int reserved;
+};
+
+// First and last page index along one axis touched by [from, to]
+bool pageSpan(qreal from, qreal to, qreal pageLength, int pages, int &first, int &last)
+{
+    first = int(qBound<qreal>(0, std::floor(from / pageLength), pages));
+    last = int(qBound<qreal>(-1, std::floor(to / pageLength), pages - 1));
+    return first <= last;
+}
+
+} // namespace
+
+namespace PagePipeline {
+
+QRectF Grid::pageRect(int page) const
+{
+    const int col = page % cols;
+    const int row = page / cols;
+    return QRectF(QPointF(col * pageSize.width(), row * pageSize.height()), pageSize);
+}
+
+Grid grid(const QSizeF &canvasSize, const QSizeF &pageSize)
+{
+    Grid result;
+    result.pageSize = pageSize;
+    if (pageSize.width() > 0 && pageSize.height() > 0)
+    {
+        result.cols = std::max(1, qCeil(canvasSize.width() / pageSize.width()));
+        result.rows = std::max(1, qCeil(canvasSize.height() / pageSize.height()));
+    }
+    return result;
+}
+
+QVector<QVector<ShapeId>> partition(const ShapeStore &shapes, const QTransform &toCanvas, const Grid &grid,
+                                    qreal bleed)
+{
+    PROFILE_SCOPE("partition");
+    QVector<QVector<ShapeId>> pages(grid.count());
+    if (grid.pageSize.isEmpty())
+        return pages;
+
+    // Both corners of every box go through the view transform one run of the
+    // store at a time; a box covers one unit past its max corner, see
+    // drawShapes()
+    const qreal scaleX = toCanvas.m11();
+    const qreal scaleY = toCanvas.m22();
+    const int runLength = ShapeStore::runLength;
+    QVector<double> buffers(4 * runLength);
+    double *x0 = buffers.data();
+    double *y0 = x0 + runLength;
+    double *x1 = y0 + runLength;
+    double *y1 = x1 + runLength;
+    for (int run = 0; run < shapes.runCount(); ++run)
+    {
+        const GeometryKernels::Boxes boxes = shapes.boxRun(run);
+        const int from = run * runLength;
+        GeometryKernels::transform(boxes.minX, boxes.minY, boxes.count, scaleX, toCanvas.dx(), scaleY, toCanvas.dy(),
+                                   x0, y0);
+        GeometryKernels::transform(boxes.maxX, boxes.maxY, boxes.count, scaleX, toCanvas.dx(), scaleY, toCanvas.dy(),
+                                   x1, y1);
+        for (int i = 0; i < boxes.count; ++i)
+        {
+            const qreal ex = x1[i] + scaleX;
+            const qreal ey = y1[i] + scaleY;
+            int firstCol, lastCol, firstRow, lastRow;
+            if (!pageSpan(std::min<qreal>(x0[i], ex) - bleed, std::max<qreal>(x0[i], ex) + bleed,
+                          grid.pageSize.width(), grid.cols, firstCol, lastCol)
+                || !pageSpan(std::min<qreal>(y0[i], ey) - bleed, std::max<qreal>(y0[i], ey) + bleed,
+                             grid.pageSize.height(), grid.rows, firstRow, lastRow))
+                continue;
+
+            const ShapeId id = shapes.idAt(from + i);
+            for (int row = firstRow; row <= lastRow; ++row)
+            {
+                for (int col = firstCol; col <= lastCol; ++col)
+                    pages[row * grid.cols + col].append(id);
+            }
+        }
+    }
+
+    // Slots are not in z-order, ids are
+    QVector<std::function<void()>> tasks;
+    QVector<ShapeId> *pageData = pages.data(); // detach once, before any worker runs
+    for (int page = 0; page < pages.size(); ++page)
+        tasks.append([pageData, page] { std::sort(pageData[page].begin(), pageData[page].end()); });
+    WorkStealingPool::global().run(tasks);
+    return pages;
+}
+
+bool renderImages(int count, const QSize &pixels, const PaintFunction &paint,
+                  const std::function<bool(int page, const QImage &image)> &write)
+{
+    for (int first = 0; first < count;)
+    {
+        const PageReservation reservation(count - first);
+        const auto paintPage = [&](int i, QPainter &painter) {
+            PROFILE_SCOPE("render_page");
+            paint(first + i, painter);
+        };
+        QVector<QImage> images;
+        if (reservation.parallel())
+        {
+            images = TileRasterizer::render(QVector<QSize>(reservation.pages(), pixels), 1.0, paintPage, Qt::white);
+        }
+        else
+        {
+            QImage image(pixels, QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::white);
+            QPainter painter(&image);
+            paintPage(0, painter);
+            painter.end();
+            images.append(image);
+        }
+
+        for (int i = 0; i < images.size(); ++i)
+        {
+            if (images.at(i).isNull() || !write(first + i, images.at(i)))
+                return false;
+        }
+        first += images.size();
+    }
+    return true;
+}
+
+bool recordPictures(int count, const PaintFunction &paint,
+                    const std::function<bool(int page, const QPicture &picture)> &write)
+{
+    for (int first = 0; first < count;)
+    {
+        const PageReservation reservation(count - first);
+        QVector<QPicture> pictures(reservation.pages());
+        QPicture *results = pictures.data(); // each worker records only its own page
+        QVector<std::function<void()>> tasks;
+        tasks.reserve(pictures.size());
+        for (int i = 0; i < pictures.size(); ++i)
+        {
+            tasks.append([&, results, i] {
+                PROFILE_SCOPE("record_page");
+                QPainter painter(&results[i]);
+                paint(first + i, painter);
+            });
+        }
+        if (reservation.parallel())
+            WorkStealingPool::global().run(tasks);
+        else
+            tasks.first()();
+
+        for (int i = 0; i < pictures.size(); ++i)
+        {
+            if (!write(first + i, pictures.at(i)))
+                return false;
+        }
+        first += pictures.size();
+    }
+    return true;
+}
+
+} // namespace PagePipeline
@@ -0,0 +1,67 @@
+#ifndef PAGEPIPELINE_H
+#define PAGEPIPELINE_H
+
+#include <QImage>
+#include <QPicture>
+#include <QRectF>
+#include <QSizeF>
+#include <QTransform>
+#include <QVector>
+
+#include <functional>
+
+#include "shapestore.h"
+
+class QPainter;
+
+// Printing and export in three stages: shapes are partitioned over the pages
+// by their bounds in one pass, the pages are rendered in parallel on the
+// worker pool, and the finished pages are written to the device in order.
+// Writing is serial, so raster output gains the most: its pages are done
+// when rendered, while vector pages are encoded as they are written.
+// A page never draws a shape that lies outside it.
+namespace PagePipeline {
+
+// A canvas cut into pages, row by row. Page (col, row) covers canvas
+// [col * w, (col + 1) * w) x [row * h, (row + 1) * h) for a page size of w x h.
+struct Grid
+{
+    QSizeF pageSize;
+    int cols = 1;
+    int rows = 1;
+
+    int count() const { return cols * rows; }
+    QRectF pageRect(int page) const;
+};
+
+// The grid of pageSize pages covering a canvas of canvasSize
+Grid grid(const QSizeF &canvasSize, const QSizeF &pageSize);
+
+// The shapes each page shows, in z-order, for shapes drawn through toCanvas
+// (world to canvas; scaling and translation only). Bounds are grown by bleed
+// canvas units for pens and antialiasing.
+QVector<QVector<ShapeId>> partition(const ShapeStore &shapes, const QTransform &toCanvas, const Grid &grid,
+                                    qreal bleed);
+
+// Paints one page. Called on a pool thread, so it must only read shared state.
+using PaintFunction = std::function<void(int page, QPainter &painter)>;
+
+// Render count pages and hand them to write in page order, on the calling
+// thread. Rendering stops at the first write that fails; the result is false
+// then. Pages are rendered in parallel batches out of a budget of one page
+// per pool thread plus one, shared by every call in the process, so calls
+// running side by side, e.g. one per file, take turns rather than multiply
+// the memory held. A call that finds the budget taken renders one page at a
+// time on its own thread, so at most twice the budget of pages is ever held.
+bool renderImages(int count, const QSize &pixels, const PaintFunction &paint,
+                  const std::function<bool(int page, const QImage &image)> &write);
+// As renderImages(), but records each page as a QPicture, so vector output
+// such as PDF stays vector. Only the recording is parallel: write replays
+// the pictures onto the device, and a PDF engine encodes them there, one
+// page after another on the calling thread.
+bool recordPictures(int count, const PaintFunction &paint,
+                    const std::function<bool(int page, const QPicture &picture)> &write);
+
+} // namespace PagePipeline
+
+#endif // PAGEPIPELINE_H
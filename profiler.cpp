@@ -0,0 +1,259 @@
+#include "profiler.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+
+namespace {
+
+using Profiler::Metric;
+
+constexpr int metricCount = int(Metric::Count);
+
+const char *const metricNames[metricCount] = {
+    "frame_ms", "mouse_press_ms", "load_ms", "print_ms", "shapes_drawn",
+    "shapes_culled", "tile_hit_rate", "load_mb_per_s", "save_mb_per_s",
+};
+
+struct Window
+{
+    double values[Profiler::windowSize] = {};
+    int count = 0;
+    int next = 0;
+};
+
+// A complete event ("X") when duration >= 0, otherwise a counter ("C")
+struct TraceEvent
+{
+    const char *name = nullptr;
+    qint64 start = 0;
+    qint64 duration = -1;
+    double value = 0;
+    int thread = 0;
+};
+
+struct State
+{
+    QMutex mutex;
+    Window windows[metricCount];
+    QVector<TraceEvent> trace; // ring buffer once it reaches traceCapacity
+    int traceNext = 0;
+};
+
+State &state()
+{
+    static State instance;
+    return instance;
+}
+
+int threadNumber()
+{
+    static std::atomic<int> next{0};
+    thread_local const int number = next++;
+    return number;
+}
+
+// Caller holds the mutex
+void addEvent(State &s, const TraceEvent &event)
+{
+    if (s.trace.size() < Profiler::traceCapacity)
+    {
+        s.trace.append(event);
+        return;
+    }
+    s.trace[s.traceNext] = event;
+    s.traceNext = (s.traceNext + 1) % Profiler::traceCapacity;
+}
+
+// Caller holds the mutex
+void addSample(State &s, Metric metric, double value)
+{
+    Window &window = s.windows[int(metric)];
+    window.values[window.next] = value;
+    window.next = (window.next + 1) % Profiler::windowSize;
+    window.count = std::min(window.count + 1, Profiler::windowSize);
+}
+
+void appendMicroseconds(QByteArray &out, qint64 nsecs)
+{
+    out += QByteArray::number(nsecs / 1000.0, 'f', 3);
+}
+
+} // namespace
+
+namespace Profiler {
+
+namespace Detail {
+
+std::atomic<bool> enabled{false};
+
+qint64 now()
+{
+    static const QElapsedTimer clock = [] {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed();
+}
+
+void finishScope(const char *name, qint64 start, Metric metric)
+{
+    TraceEvent event;
+    event.name = name;
+    event.start = start;
+    event.duration = now() - start;
+    event.thread = threadNumber();
+
+    State &s = state();
+    const QMutexLocker locker(&s.mutex);
+    addEvent(s, event);
+    if (metric != Metric::Count)
+        addSample(s, metric, event.duration / 1e6);
+}
+
+} // namespace Detail
+
+void setEnabled(bool enabled)
+{
+    Detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void record(Metric metric, double value)
+{
+    if (metric == Metric::Count)
+        return;
+
+    TraceEvent event;
+    event.name = metricNames[int(metric)];
+    event.start = Detail::now();
+    event.value = value;
+    event.thread = threadNumber();
+
+    State &s = state();
+    const QMutexLocker locker(&s.mutex);
+    addEvent(s, event);
+    addSample(s, metric, value);
+}
+
+Summary summary(Metric metric)
+{
+    Summary result;
+    if (metric == Metric::Count)
+        return result;
+
+    QVector<double> values;
+    {
+        State &s = state();
+        const QMutexLocker locker(&s.mutex);
+        const Window &window = s.windows[int(metric)];
+        if (window.count == 0)
+            return result;
+        values = QVector<double>(window.values, window.values + window.count);
+        result.last = window.values[(window.next + windowSize - 1) % windowSize];
+    }
+
+    result.samples = values.size();
+    double total = 0;
+    for (double value : values)
+        total += value;
+    result.mean = total / values.size();
+    std::sort(values.begin(), values.end());
+    result.median = values.at(values.size() / 2);
+    result.p95 = values.at(std::min<int>(values.size() - 1, values.size() * 95 / 100));
+    result.max = values.last();
+    return result;
+}
+
+const char *metricName(Metric metric)
+{
+    return metric == Metric::Count ? "" : metricNames[int(metric)];
+}
+
+QString report()
+{
+    QStringList lines;
+    for (int i = 0; i < metricCount; ++i)
+    {
+        const Summary s = summary(Metric(i));
+        if (s.samples == 0)
+            continue;
+        lines.append(QString("%1: last %2, median %3, p95 %4, max %5 (%6 samples)")
+                         .arg(metricNames[i])
+                         .arg(s.last, 0, 'f', 2)
+                         .arg(s.median, 0, 'f', 2)
+                         .arg(s.p95, 0, 'f', 2)
+                         .arg(s.max, 0, 'f', 2)
+                         .arg(s.samples));
+    }
+    return lines.join("\n");
+}
+
+void reset()
+{
+    State &s = state();
+    const QMutexLocker locker(&s.mutex);
+    for (Window &window : s.windows)
+        window = Window();
+    s.trace.clear();
+    s.traceNext = 0;
+}
+
+bool writeTrace(const QString &path)
+{
+    // Copy under the lock, oldest event first, and format without it
+    QVector<TraceEvent> events;
+    {
+        State &s = state();
+        const QMutexLocker locker(&s.mutex);
+        events.reserve(s.trace.size());
+        for (int i = 0; i < s.trace.size(); ++i)
+            events.append(s.trace.at((s.traceNext + i) % s.trace.size()));
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    // Names are identifiers from the probes, so they need no escaping
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (int i = 0; i < events.size(); ++i)
+    {
+        const TraceEvent &event = events.at(i);
+        out += "{\"name\":\"";
+        out += event.name;
+        out += event.duration >= 0 ? "\",\"ph\":\"X\",\"ts\":" : "\",\"ph\":\"C\",\"ts\":";
+        appendMicroseconds(out, event.start);
+        if (event.duration >= 0)
+        {
+            out += ",\"dur\":";
+            appendMicroseconds(out, event.duration);
+        }
+        else
+        {
+            out += ",\"args\":{\"value\":";
+            out += QByteArray::number(event.value, 'g', 10);
+            out += "}";
+        }
+        out += ",\"pid\":1,\"tid\":";
+        out += QByteArray::number(event.thread);
+        out += i + 1 < events.size() ? "},\n" : "}\n";
+
+        if (out.size() >= (1 << 20))
+        {
+            if (file.write(out) != out.size())
+                return false;
+            out.clear();
+        }
+    }
+    out += "]}\n";
+    return file.write(out) == out.size() && file.commit();
+}
+
+} // namespace Profiler
@@ -0,0 +1,122 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QString>
+
+#include <atomic>
+
+// Build with DEFINES += VIBECAD_PROFILING=0 to compile every probe out
+#ifndef VIBECAD_PROFILING
+#define VIBECAD_PROFILING 1
+#endif
+
+// Scoped timers and counters on the hot paths. Probes are off until
+// setEnabled(true); while off, each costs one relaxed atomic load. While on,
+// every metric keeps a rolling window of its latest samples, and timed
+// scopes and samples are also kept as a trace that writeTrace() saves in
+// Chrome's trace event format (chrome://tracing, Perfetto). Probes may fire
+// on any thread.
+namespace Profiler {
+
+enum class Metric
+{
+    FrameMs,
+    MousePressMs,
+    LoadMs,
+    PrintMs,
+    ShapesDrawn,  // distinct shapes in the tiles a frame rasterized
+    ShapesCulled, // the rest of the scene, left out of those tiles
+    TileHitRate,  // percent of visible tiles found in the cache
+    LoadMBps,
+    SaveMBps,
+    Count
+};
+
+// Samples kept per metric
+constexpr int windowSize = 256;
+// Trace events kept; older ones are dropped first
+constexpr int traceCapacity = 1 << 20;
+
+namespace Detail {
+extern std::atomic<bool> enabled;
+qint64 now(); // nanoseconds since the first probe
+void finishScope(const char *name, qint64 start, Metric metric);
+} // namespace Detail
+
+inline bool isEnabled()
+{
+#if VIBECAD_PROFILING
+    return Detail::enabled.load(std::memory_order_relaxed);
+#else
+    return false;
+#endif
+}
+void setEnabled(bool enabled);
+
+// Adds a sample to the metric's window and a counter event to the trace
+void record(Metric metric, double value);
+
+struct Summary
+{
+    int samples = 0;
+    double last = 0;
+    double mean = 0;
+    double median = 0;
+    double p95 = 0;
+    double max = 0;
+};
+Summary summary(Metric metric);
+const char *metricName(Metric metric);
+
+// One line per metric that has samples, for a status bar or a log
+QString report();
+
+// Drops every sample and trace event
+void reset();
+bool writeTrace(const QString &path);
+
+// Times its own lifetime as a trace event named name, and as a sample of
+// metric unless that is Metric::Count. name must outlive the trace.
+class Scope
+{
+public:
+    explicit Scope(const char *name, Metric metric = Metric::Count)
+        : name(name), metric(metric), start(isEnabled() ? Detail::now() : -1)
+    {
+    }
+    ~Scope()
+    {
+        if (start >= 0)
+            Detail::finishScope(name, start, metric);
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *name;
+    Metric metric;
+    qint64 start;
+};
+
+} // namespace Profiler
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#if VIBECAD_PROFILING
+// PROFILE_SCOPE("name") or PROFILE_SCOPE("name", Profiler::Metric::...)
+#define PROFILE_SCOPE(...) const Profiler::Scope PROFILER_CONCAT(profilerScope, __LINE__)(__VA_ARGS__)
+// value is only evaluated while profiling is on
+#define PROFILE_RECORD(metric, value)                                                                             \
+    do                                                                                                             \
+    {                                                                                                              \
+        if (Profiler::isEnabled())                                                                                 \
+            Profiler::record(metric, value);                                                                       \
+    } while (false)
+#else
+#define PROFILE_SCOPE(...) do {} while (false)
+#define PROFILE_RECORD(metric, value) do {} while (false)
+#endif
+
+#endif // PROFILER_H
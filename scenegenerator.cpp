@@ -0,0 +1,40 @@
+#include "scenegenerator.h"
+#include "shapestore.h"
+
+#include <QRandomGenerator>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+
+namespace SceneGenerator {
+
+int sideForCount(int count)
+{
+    // About one shape per 20 x 20 units, never smaller than the A4 sheet
+    return std::max(297, int(qCeil(std::sqrt(qreal(count)) * 20)));
+}
+
+void generate(ShapeStore &shapes, int count, int side, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    shapes.reserve(shapes.size() + count);
+    for (int i = 0; i < count; ++i)
+    {
+        const int x = int(random.bounded(quint32(side)));
+        const int y = int(random.bounded(quint32(side)));
+        if (i % 2 == 0)
+        {
+            const int w = 2 + int(random.bounded(39u));
+            const int h = 2 + int(random.bounded(39u));
+            shapes.addRectangle(QRect(x, y, w, h));
+        }
+        else
+        {
+            const int r = 1 + int(random.bounded(20u));
+            shapes.addCircle(QPoint(x + r, y + r), r);
+        }
+    }
+}
+
+} // namespace SceneGenerator
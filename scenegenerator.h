@@ -0,0 +1,22 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include <QtGlobal>
+
+class ShapeStore;
+
+// Deterministic synthetic scenes for benchmarks and load testing.
+namespace SceneGenerator {
+
+// Side of the square world area that keeps count shapes at the density of
+// a busy hand-drawn sheet, so any view sees a similar number of shapes.
+int sideForCount(int count);
+
+// Appends count shapes, alternating rectangles and circles, with 2..40 unit
+// extents and bottom-left corners inside [0, side) x [0, side). The same
+// seed always yields the same scene.
+void generate(ShapeStore &shapes, int count, int side, quint32 seed = 1);
+
+} // namespace SceneGenerator
+
+#endif // SCENEGENERATOR_H
@@ -0,0 +1,965 @@
+#include "sceneio.h"
+#include "profiler.h"
+#include "shapestore.h"
+#include "threadpool.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+namespace {
+
+// Same nesting limit as QJsonDocument
+constexpr int maxDepth = 1024;
+
+// Shapes between two progress reports
+constexpr int progressInterval = 64 * 1024;
+
+// Hand-rolled pull parser for the scene schema. It accepts the same input as
+// QJsonDocument::fromJson() followed by the old per-shape QJsonObject reads:
+// unknown keys and values are skipped, non-integral or out-of-range
+// coordinates read as 0 (QJsonValue::toInt()), and shapes are appended to
+// the store as soon as their object closes.
+class JsonSceneParser
+{
+public:
+    JsonSceneParser(const char *begin, const char *end, ShapeStore &shapes, const SceneIO::Progress &progress)
+        : p(begin), begin(begin), end(end), shapes(shapes), progress(progress)
+    {
+    }
+
+    bool parse();
+
+private:
+    enum class Section
+    {
+        Other,
+        Rectangles,
+        Circles
+    };
+
+    void skipWhitespace();
+    bool consume(char c);
+    bool readString(const char *&str, qsizetype &len);
+    bool readInt(int &value);
+    bool skipValue(int depth);
+    bool skipLiteral(const char *literal);
+    bool parseShapeArray(Section section);
+    bool parseShape(Section section);
+
+    static bool keyIs(const char *str, qsizetype len, const char *key);
+
+    const char *p;
+    const char *begin;
+    const char *end;
+    ShapeStore &shapes;
+    const SceneIO::Progress &progress;
+    int sinceReport = 0;
+    QByteArray unescaped;
+};
+
+void JsonSceneParser::skipWhitespace()
+{
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        ++p;
+}
+
+bool JsonSceneParser::consume(char c)
+{
+    skipWhitespace();
+    if (p >= end || *p != c)
+        return false;
+    ++p;
+    return true;
+}
+
+bool JsonSceneParser::keyIs(const char *str, qsizetype len, const char *key)
+{
+    return qsizetype(std::strlen(key)) == len && std::memcmp(str, key, size_t(len)) == 0;
+}
+
+bool JsonSceneParser::readString(const char *&str, qsizetype &len)
+{
+    if (!consume('"'))
+        return false;
+
+    const char *start = p;
+    bool escaped = false;
+    while (p < end && *p != '"')
+    {
+        if (uchar(*p) < 0x20)
+            return false;
+        if (*p == '\\')
+        {
+            escaped = true;
+            if (++p >= end)
+                return false;
+        }
+        ++p;
+    }
+    if (p >= end)
+        return false;
+
+    str = start;
+    len = p - start;
+    ++p;
+    if (!escaped)
+        return true;
+
+    // Keys we care about are plain ASCII; decode just enough to compare them
+    unescaped.clear();
+    for (const char *s = start; s < start + len; ++s)
+    {
+        if (*s != '\\')
+        {
+            unescaped.append(*s);
+            continue;
+        }
+        switch (*++s)
+        {
+        case '"': unescaped.append('"'); break;
+        case '\\': unescaped.append('\\'); break;
+        case '/': unescaped.append('/'); break;
+        case 'b': unescaped.append('\b'); break;
+        case 'f': unescaped.append('\f'); break;
+        case 'n': unescaped.append('\n'); break;
+        case 'r': unescaped.append('\r'); break;
+        case 't': unescaped.append('\t'); break;
+        case 'u':
+        {
+            if (start + len - s < 5)
+                return false;
+            bool ok = false;
+            const int code = QByteArray(s + 1, 4).toInt(&ok, 16);
+            if (!ok)
+                return false;
+            unescaped.append(code < 0x80 ? char(code) : '?');
+            s += 4;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    str = unescaped.constData();
+    len = unescaped.size();
+    return true;
+}
+
+bool JsonSceneParser::readInt(int &value)
+{
+    skipWhitespace();
+    const char *start = p;
+    if (p < end && *p == '-')
+        ++p;
+    if (p >= end || *p < '0' || *p > '9')
+        return false;
+
+    // Fast path: plain integers are all saveToFile() ever writes
+    qint64 magnitude = 0;
+    int digits = 0;
+    if (*p == '0')
+    {
+        ++p;
+        digits = 1;
+    }
+    else
+    {
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (digits < 18)
+                magnitude = magnitude * 10 + (*p - '0');
+            ++digits;
+            ++p;
+        }
+    }
+
+    const bool isInteger = p >= end || (*p != '.' && *p != 'e' && *p != 'E');
+    if (isInteger && digits <= 18)
+    {
+        const qint64 v = *start == '-' ? -magnitude : magnitude;
+        const bool fits = v >= std::numeric_limits<int>::min() && v <= std::numeric_limits<int>::max();
+        value = fits ? int(v) : 0;
+        return true;
+    }
+
+    if (p < end && *p == '.')
+    {
+        ++p;
+        if (p >= end || *p < '0' || *p > '9')
+            return false;
+        while (p < end && *p >= '0' && *p <= '9')
+            ++p;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        if (p < end && (*p == '+' || *p == '-'))
+            ++p;
+        if (p >= end || *p < '0' || *p > '9')
+            return false;
+        while (p < end && *p >= '0' && *p <= '9')
+            ++p;
+    }
+
+    // The mapped file is not NUL-terminated, so strtod gets its own copy
+    const QByteArray text(start, p - start);
+    const double d = std::strtod(text.constData(), nullptr);
+    const bool integral = std::isfinite(d) && d == std::trunc(d)
+                          && d >= std::numeric_limits<int>::min()
+                          && d <= std::numeric_limits<int>::max();
+    value = integral ? int(d) : 0;
+    return true;
+}
+
+bool JsonSceneParser::skipLiteral(const char *literal)
+{
+    const qsizetype len = qsizetype(std::strlen(literal));
+    if (end - p < len || std::memcmp(p, literal, size_t(len)) != 0)
+        return false;
+    p += len;
+    return true;
+}
+
+bool JsonSceneParser::skipValue(int depth)
+{
+    if (depth > maxDepth)
+        return false;
+
+    skipWhitespace();
+    if (p >= end)
+        return false;
+
+    switch (*p)
+    {
+    case '{':
+    {
+        ++p;
+        if (consume('}'))
+            return true;
+        do
+        {
+            const char *str;
+            qsizetype len;
+            if (!readString(str, len) || !consume(':') || !skipValue(depth + 1))
+                return false;
+        } while (consume(','));
+        return consume('}');
+    }
+    case '[':
+    {
+        ++p;
+        if (consume(']'))
+            return true;
+        do
+        {
+            if (!skipValue(depth + 1))
+                return false;
+        } while (consume(','));
+        return consume(']');
+    }
+    case '"':
+    {
+        const char *str;
+        qsizetype len;
+        return readString(str, len);
+    }
+    case 't':
+        return skipLiteral("true");
+    case 'f':
+        return skipLiteral("false");
+    case 'n':
+        return skipLiteral("null");
+    default:
+    {
+        int ignored;
+        return readInt(ignored);
+    }
+    }
+}
+
+bool JsonSceneParser::parseShape(Section section)
+{
+    // bl_x, bl_y, tr_x, tr_y for rectangles; cx, cy, r for circles
+    int fields[4] = {0, 0, 0, 0};
+
+    skipWhitespace();
+    if (p >= end)
+        return false;
+    if (*p != '{')
+    {
+        // Non-object entries read as an empty object, i.e. all zeros
+        if (!skipValue(1))
+            return false;
+    }
+    else
+    {
+        ++p;
+        if (!consume('}'))
+        {
+            do
+            {
+                const char *key;
+                qsizetype len;
+                if (!readString(key, len) || !consume(':'))
+                    return false;
+
+                int field = -1;
+                if (section == Section::Rectangles)
+                {
+                    if (keyIs(key, len, "bl_x"))
+                        field = 0;
+                    else if (keyIs(key, len, "bl_y"))
+                        field = 1;
+                    else if (keyIs(key, len, "tr_x"))
+                        field = 2;
+                    else if (keyIs(key, len, "tr_y"))
+                        field = 3;
+                }
+                else if (keyIs(key, len, "cx"))
+                    field = 0;
+                else if (keyIs(key, len, "cy"))
+                    field = 1;
+                else if (keyIs(key, len, "r"))
+                    field = 2;
+
+                skipWhitespace();
+                const bool isNumber = p < end && (*p == '-' || (*p >= '0' && *p <= '9'));
+                if (field >= 0 && isNumber)
+                {
+                    if (!readInt(fields[field]))
+                        return false;
+                }
+                else
+                {
+                    if (!skipValue(2))
+                        return false;
+                    if (field >= 0)
+                        fields[field] = 0;
+                }
+            } while (consume(','));
+
+            if (!consume('}'))
+                return false;
+        }
+    }
+
+    if (section == Section::Rectangles)
+        shapes.addRectangle(QRect(QPoint(fields[0], fields[1]), QPoint(fields[2], fields[3])));
+    else if (fields[2] > 0)
+        shapes.addCircle(QPoint(fields[0], fields[1]), fields[2]);
+    return true;
+}
+
+bool JsonSceneParser::parseShapeArray(Section section)
+{
+    skipWhitespace();
+    if (p >= end || *p != '[')
+        return skipValue(1); // not an array: toArray() would have been empty
+
+    ++p;
+    if (consume(']'))
+        return true;
+    do
+    {
+        if (!parseShape(section))
+            return false;
+        if (++sinceReport == progressInterval)
+        {
+            sinceReport = 0;
+            if (progress && !progress(p - begin, end - begin))
+                return false;
+        }
+    } while (consume(','));
+    return consume(']');
+}
+
+bool JsonSceneParser::parse()
+{
+    // A UTF-8 byte order mark is accepted by QJsonDocument as well
+    if (end - p >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+        p += 3;
+
+    if (!consume('{'))
+        return false;
+    if (!consume('}'))
+    {
+        do
+        {
+            const char *key;
+            qsizetype len;
+            if (!readString(key, len) || !consume(':'))
+                return false;
+
+            bool ok;
+            if (keyIs(key, len, "rectangles"))
+                ok = parseShapeArray(Section::Rectangles);
+            else if (keyIs(key, len, "circles"))
+                ok = parseShapeArray(Section::Circles);
+            else
+                ok = skipValue(1);
+            if (!ok)
+                return false;
+        } while (consume(','));
+
+        if (!consume('}'))
+            return false;
+    }
+
+    skipWhitespace();
+    return p == end;
+}
+
+constexpr char binaryMagic[4] = {'V', 'C', 'S', 'B'};
+constexpr quint32 binaryVersion = 3;
+constexpr qint64 binaryHeaderSizeV1 = 32;
+constexpr qint64 binaryHeaderSize = 48;
+constexpr qint64 rectRecordSize = 4 * sizeof(qint32);
+constexpr qint64 circleRecordSize = 3 * sizeof(qint32);
+// Version 3: kind, id and the four bounding-box columns
+constexpr qint64 columnRecordSize = 1 + sizeof(quint32) + 4 * sizeof(qint32);
+
+// Highest shape id a binary scene may use: this many ids per shape, and at
+// least minIdLimit (a 64 MB id table) however small the scene
+constexpr qint64 maxIdsPerShape = 64;
+constexpr qint64 minIdLimit = 1 << 24;
+
+bool isBinary(const char *data, qint64 size)
+{
+    return size >= qint64(sizeof(binaryMagic)) && std::memcmp(data, binaryMagic, sizeof(binaryMagic)) == 0;
+}
+
+// Hands the whole file to parse(), memory-mapped when the file allows it
+template<typename Parse>
+bool parseFile(const QString &path, Parse parse)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = file.size();
+    if (size <= 0)
+        return false;
+
+    if (uchar *mapped = file.map(0, size))
+    {
+        const bool ok = parse(reinterpret_cast<const char *>(mapped), size);
+        file.unmap(mapped);
+        return ok;
+    }
+
+    // Not mappable (e.g. a pipe or some network shares): fall back to a read
+    const QByteArray data = file.readAll();
+    return parse(data.constData(), qint64(data.size()));
+}
+
+// Fixed-size staging buffer so binary saves never hold a second copy of the scene
+class BlockWriter
+{
+public:
+    explicit BlockWriter(QIODevice &device)
+        : device(device)
+    {
+    }
+
+    void putInt32(qint32 value)
+    {
+        reserve(sizeof(value));
+        qToLittleEndian(value, buffer + used);
+        used += int(sizeof(value));
+    }
+
+    void putUInt32(quint32 value)
+    {
+        reserve(sizeof(value));
+        qToLittleEndian(value, buffer + used);
+        used += int(sizeof(value));
+    }
+
+    void putUInt8(quint8 value)
+    {
+        reserve(1);
+        buffer[used++] = char(value);
+    }
+
+    void putRaw(const char *data, int size)
+    {
+        reserve(size);
+        std::memcpy(buffer + used, data, size_t(size));
+        used += size;
+    }
+
+    bool flush()
+    {
+        if (used > 0 && device.write(buffer, used) != used)
+            ok = false;
+        used = 0;
+        return ok;
+    }
+
+private:
+    void reserve(int bytes)
+    {
+        if (used + bytes > int(sizeof(buffer)))
+            flush();
+    }
+
+    QIODevice &device;
+    char buffer[64 * 1024];
+    int used = 0;
+    bool ok = true;
+};
+
+// Ids per chunk of a JSON save; each chunk is formatted by one pool thread
+constexpr int jsonChunkIds = 16 * 1024;
+// Room for the longest element of either array,
+// ,{"bl_x":-2147483648,"bl_y":-2147483648,"tr_x":-2147483648,"tr_y":-2147483648}
+constexpr int maxJsonElementSize = 80;
+
+template<int N>
+char *appendLiteral(char *out, const char (&text)[N])
+{
+    std::memcpy(out, text, N - 1);
+    return out + N - 1;
+}
+
+// Decimal digits, as QJsonDocument writes integral numbers
+char *appendInt(char *out, qint32 value)
+{
+    char digits[10];
+    quint32 magnitude = value < 0 ? 0u - quint32(value) : quint32(value);
+    int count = 0;
+    do
+    {
+        digits[count++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0)
+        *out++ = '-';
+    while (count > 0)
+        *out++ = digits[--count];
+    return out;
+}
+
+// Formats the shapes of kind with ids in [first, last) as JSON array
+// elements, each preceded by a comma, the keys in QJsonObject order.
+// Returns the end of the output; count is set to the shapes written.
+char *formatJsonChunk(const ShapeStore &shapes, ShapeKind kind, ShapeId first, ShapeId last, char *out, int &count)
+{
+    count = 0;
+    for (ShapeId id = first; id < last; ++id)
+    {
+        const int slot = shapes.slotOf(id);
+        if (slot < 0 || shapes.kindAt(slot) != kind)
+            continue;
+
+        ++count;
+        if (kind == ShapeKind::Rectangle)
+        {
+            const QRect r = shapes.rectAt(slot);
+            out = appendInt(appendLiteral(out, ",{\"bl_x\":"), r.bottomLeft().x());
+            out = appendInt(appendLiteral(out, ",\"bl_y\":"), r.bottomLeft().y());
+            out = appendInt(appendLiteral(out, ",\"tr_x\":"), r.topRight().x());
+            out = appendInt(appendLiteral(out, ",\"tr_y\":"), r.topRight().y());
+        }
+        else
+        {
+            const QPoint c = shapes.centerAt(slot);
+            out = appendInt(appendLiteral(out, ",{\"cx\":"), c.x());
+            out = appendInt(appendLiteral(out, ",\"cy\":"), c.y());
+            out = appendInt(appendLiteral(out, ",\"r\":"), shapes.radiusAt(slot));
+        }
+        *out++ = '}';
+    }
+    return out;
+}
+
+// Version 3 body: the store's own columns, so they are appended a chunk at
+// a time rather than decoded shape by shape
+bool parseColumns(const char *data, qint64 total, qint64 rectCount, ShapeId idLimit, ShapeStore &shapes,
+                  const SceneIO::Progress &progress)
+{
+    const char *kinds = data;
+    const char *ids = kinds + total;
+    const char *minX = ids + total * qint64(sizeof(quint32));
+    const char *minY = minX + total * qint64(sizeof(qint32));
+    const char *maxX = minY + total * qint64(sizeof(qint32));
+    const char *maxY = maxX + total * qint64(sizeof(qint32));
+
+    constexpr int chunk = ShapeStore::runLength;
+    QVector<ShapeKind> kindChunk(chunk);
+    QVector<ShapeId> idChunk(chunk);
+    QVector<qint32> boxChunk(4 * chunk);
+    qint32 *x0 = boxChunk.data();
+    qint32 *y0 = x0 + chunk;
+    qint32 *x1 = y0 + chunk;
+    qint32 *y1 = x1 + chunk;
+
+    qint64 rects = 0;
+    for (qint64 first = 0; first < total; first += chunk)
+    {
+        if (progress && first % progressInterval == 0 && first > 0 && !progress(first, total))
+            return false;
+        const int count = int(std::min<qint64>(chunk, total - first));
+        const qint64 offset = first * qint64(sizeof(qint32));
+        qFromLittleEndian<quint32>(ids + offset, count, idChunk.data());
+        qFromLittleEndian<qint32>(minX + offset, count, x0);
+        qFromLittleEndian<qint32>(minY + offset, count, y0);
+        qFromLittleEndian<qint32>(maxX + offset, count, x1);
+        qFromLittleEndian<qint32>(maxY + offset, count, y1);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const quint8 kind = quint8(kinds[first + i]);
+            if (kind > quint8(ShapeKind::Circle) || idChunk.at(i) > idLimit || x0[i] > x1[i] || y0[i] > y1[i])
+                return false;
+            kindChunk[i] = ShapeKind(kind);
+            rects += kind == quint8(ShapeKind::Rectangle) ? 1 : 0;
+        }
+        if (!shapes.appendColumns(idChunk.constData(), kindChunk.constData(), x0, y0, x1, y1, count))
+            return false;
+    }
+    return rects == rectCount;
+}
+
+template<int N>
+bool writeLiteral(QIODevice &device, const char (&text)[N])
+{
+    return device.write(text, N - 1) == N - 1;
+}
+
+// Runs io, which reads or writes path, and records its throughput in MB/s
+template <typename F>
+bool measureThroughput(const QString &path, Profiler::Metric metric, F io)
+{
+    if (!Profiler::isEnabled())
+        return io();
+
+    QElapsedTimer timer;
+    timer.start();
+    const bool ok = io();
+    if (ok)
+        Profiler::record(metric, QFileInfo(path).size() * 1e3 / std::max<qint64>(1, timer.nsecsElapsed()));
+    return ok;
+}
+
+} // namespace
+
+namespace SceneIO {
+
+Format formatForPath(const QString &path)
+{
+    return QFileInfo(path).suffix().toLower() == QString::fromLatin1(binarySuffix) ? Format::Binary : Format::Json;
+}
+
+bool load(const QString &path, ShapeStore &shapes, quint64 *generation, const Progress &progress)
+{
+    if (generation)
+        *generation = 0;
+    return measureThroughput(path, Profiler::Metric::LoadMBps, [&] {
+        return parseFile(path, [&](const char *data, qint64 size) {
+            return isBinary(data, size) ? parseBinary(data, size, shapes, generation, progress)
+                                        : parseJson(data, size, shapes, progress);
+        });
+    });
+}
+
+bool save(const QString &path, const ShapeStore &shapes)
+{
+    return save(path, shapes, formatForPath(path));
+}
+
+bool save(const QString &path, const ShapeStore &shapes, Format format, const Progress &progress)
+{
+    return measureThroughput(path, Profiler::Metric::SaveMBps, [&] {
+        return format == Format::Binary ? saveBinary(path, shapes, 0, progress) : saveJson(path, shapes, progress);
+    });
+}
+
+bool convert(const QString &from, const QString &to)
+{
+    ShapeStore shapes;
+    return load(from, shapes) && save(to, shapes);
+}
+
+bool parseJson(const char *data, qint64 size, ShapeStore &shapes, const Progress &progress)
+{
+    // Every shape is one JSON object, so counting braces sizes the store
+    // exactly in a single memchr sweep instead of growing it while parsing
+    qint64 objects = 0;
+    for (const char *s = data, *e = data + size; (s = static_cast<const char *>(std::memchr(s, '{', size_t(e - s)))); ++s)
+        ++objects;
+    shapes.clear();
+    shapes.reserve(int(std::max<qint64>(0, std::min<qint64>(objects - 1, std::numeric_limits<int>::max()))));
+
+    JsonSceneParser parser(data, data + size, shapes, progress);
+    return parser.parse() && (!progress || progress(size, size));
+}
+
+bool loadJson(const QString &path, ShapeStore &shapes)
+{
+    return parseFile(path, [&](const char *data, qint64 size) {
+        return parseJson(data, size, shapes);
+    });
+}
+
+bool saveJson(const QString &path, const ShapeStore &shapes, const Progress &progress)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    // Chunks of ids are formatted in parallel, a batch of them at a time into
+    // one fixed buffer, and written in order. Ids run in z-order, so every
+    // array keeps the z-order of its shapes.
+    const qint64 endId = shapes.nextShapeId();
+    const int batch = WorkStealingPool::global().threadCount() + 1;
+    const int chunkBytes = jsonChunkIds * maxJsonElementSize;
+    QByteArray buffer(batch * chunkBytes, Qt::Uninitialized);
+    char *chunkData = buffer.data(); // detach once, before any worker runs
+    QVector<int> lengths(batch);
+    QVector<int> counts(batch);
+    int *lengthData = lengths.data();
+    int *countData = counts.data();
+    qint64 done = 0;
+
+    // Every element is formatted with a leading comma, which the first one
+    // written drops
+    const auto writeArray = [&](ShapeKind kind) {
+        bool first = true;
+        for (qint64 batchFirst = 1; batchFirst < endId; batchFirst += qint64(batch) * jsonChunkIds)
+        {
+            const int chunks = int(std::min<qint64>(batch, (endId - batchFirst + jsonChunkIds - 1) / jsonChunkIds));
+            QVector<std::function<void()>> tasks;
+            for (int chunk = 0; chunk < chunks; ++chunk)
+            {
+                const ShapeId from = ShapeId(batchFirst + qint64(chunk) * jsonChunkIds);
+                const ShapeId to = ShapeId(std::min<qint64>(endId, from + qint64(jsonChunkIds)));
+                tasks.append([&shapes, kind, from, to, chunk, chunkBytes, chunkData, lengthData, countData] {
+                    char *begin = chunkData + qint64(chunk) * chunkBytes;
+                    lengthData[chunk] = int(formatJsonChunk(shapes, kind, from, to, begin, countData[chunk]) - begin);
+                });
+            }
+            WorkStealingPool::global().run(tasks);
+
+            for (int chunk = 0; chunk < chunks; ++chunk)
+            {
+                if (lengths.at(chunk) == 0)
+                    continue;
+                const int skip = first ? 1 : 0;
+                const qint64 length = lengths.at(chunk) - skip;
+                if (file.write(chunkData + qint64(chunk) * chunkBytes + skip, length) != length)
+                    return false;
+                first = false;
+                done += counts.at(chunk);
+            }
+            if (progress && !progress(done, shapes.size()))
+                return false;
+        }
+        return true;
+    };
+
+    // QJsonDocument's compact form, which sorts keys: circles come first
+    if (!writeLiteral(file, "{\"circles\":[") || !writeArray(ShapeKind::Circle)
+        || !writeLiteral(file, "],\"rectangles\":[") || !writeArray(ShapeKind::Rectangle)
+        || !writeLiteral(file, "]}"))
+        return false;
+    return file.commit();
+}
+
+bool parseBinary(const char *data, qint64 size, ShapeStore &shapes, quint64 *generation, const Progress &progress)
+{
+    if (size < binaryHeaderSizeV1 || !isBinary(data, size))
+        return false;
+    const quint32 version = qFromLittleEndian<quint32>(data + 4);
+    if (version < 1 || version > binaryVersion)
+        return false;
+    const qint64 headerSize = version == 1 ? binaryHeaderSizeV1 : binaryHeaderSize;
+    if (size < headerSize)
+        return false;
+
+    const qint64 rectCount = qFromLittleEndian<quint32>(data + 8);
+    const qint64 circleCount = qFromLittleEndian<quint32>(data + 12);
+    const qint64 total = rectCount + circleCount;
+    if (total > std::numeric_limits<int>::max())
+        return false;
+    const qint64 idBlockSize = version == 1 ? 0 : total * qint64(sizeof(quint32));
+    const qint64 bodySize = version == 3 ? total * columnRecordSize
+                                         : rectCount * rectRecordSize + circleCount * circleRecordSize + total
+                                               + idBlockSize;
+    if (size != headerSize + bodySize)
+        return false;
+
+    shapes.clear();
+    shapes.reserve(int(total));
+
+    // Version 1 hands out fresh ids in z-order; later versions restore the
+    // saved ids, which must be ascending since id order is the z-order.
+    // Deleting shapes leaves gaps in the ids, but an id far past the shape
+    // count is damage, and would size the id table by it.
+    const ShapeId idLimit = ShapeId(std::min<qint64>(MaxShapeId, std::max(total * maxIdsPerShape, minIdLimit)));
+    // Next id and generation, read once the shapes are in
+    const auto applyHeader = [&] {
+        const ShapeId nextId = qFromLittleEndian<quint32>(data + 32);
+        if (nextId > idLimit + 1 || !shapes.reserveIds(nextId))
+            return false;
+        if (generation)
+            *generation = qFromLittleEndian<quint64>(data + 40);
+        return !progress || progress(total, total);
+    };
+    if (version == 3)
+        return parseColumns(data + headerSize, total, rectCount, idLimit, shapes, progress) && applyHeader();
+
+    const char *rect = data + headerSize;
+    const char *circle = rect + rectCount * rectRecordSize;
+    const char *kinds = circle + circleCount * circleRecordSize;
+    const char *ids = kinds + total; // version 2
+    const char *rectEnd = circle;
+    const char *circleEnd = kinds;
+
+    ShapeId previousId = InvalidShapeId;
+    auto add = [&](qint64 i, ShapeKind kind, const QRect &bounds) {
+        if (version == 1)
+        {
+            if (kind == ShapeKind::Rectangle)
+                shapes.addRectangle(bounds);
+            else
+                shapes.addCircle(bounds.center(), bounds.width() / 2);
+            return true;
+        }
+        const ShapeId id = qFromLittleEndian<quint32>(ids + i * qint64(sizeof(quint32)));
+        if (id <= previousId || id > idLimit)
+            return false;
+        previousId = id;
+        return shapes.restore({id, kind, bounds});
+    };
+
+    // The kind block interleaves the two coordinate blocks back into z-order
+    for (qint64 i = 0; i < total; ++i)
+    {
+        if (progress && i % progressInterval == 0 && i > 0 && !progress(i, total))
+            return false;
+        if (ShapeKind(quint8(kinds[i])) == ShapeKind::Rectangle)
+        {
+            if (rect == rectEnd)
+                return false;
+            const qint32 x0 = qFromLittleEndian<qint32>(rect);
+            const qint32 y0 = qFromLittleEndian<qint32>(rect + 4);
+            const qint32 x1 = qFromLittleEndian<qint32>(rect + 8);
+            const qint32 y1 = qFromLittleEndian<qint32>(rect + 12);
+            if (!add(i, ShapeKind::Rectangle, QRect(QPoint(x0, y0), QPoint(x1, y1)).normalized()))
+                return false;
+            rect += rectRecordSize;
+        }
+        else if (ShapeKind(quint8(kinds[i])) == ShapeKind::Circle)
+        {
+            if (circle == circleEnd)
+                return false;
+            const qint32 cx = qFromLittleEndian<qint32>(circle);
+            const qint32 cy = qFromLittleEndian<qint32>(circle + 4);
+            const qint32 r = qFromLittleEndian<qint32>(circle + 8);
+            if (r > 0 && !add(i, ShapeKind::Circle, QRect(QPoint(cx - r, cy - r), QPoint(cx + r, cy + r))))
+                return false;
+            circle += circleRecordSize;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (version != 1)
+        return applyHeader();
+    return !progress || progress(total, total);
+}
+
+bool loadBinary(const QString &path, ShapeStore &shapes, quint64 *generation)
+{
+    return parseFile(path, [&](const char *data, qint64 size) {
+        return parseBinary(data, size, shapes, generation);
+    });
+}
+
+bool saveBinary(const QString &path, const ShapeStore &shapes, quint64 generation, const Progress &progress)
+{
+    quint32 rectCount = 0;
+    const int count = shapes.size();
+    for (int slot = 0; slot < count; ++slot)
+    {
+        if (shapes.kindAt(slot) == ShapeKind::Rectangle)
+            ++rectCount;
+    }
+
+    // An empty scene stores zero bounds
+    const QRect extent = shapes.extent();
+    const qint32 minX = count > 0 ? extent.left() : 0;
+    const qint32 minY = count > 0 ? extent.top() : 0;
+    const qint32 maxX = count > 0 ? extent.right() : 0;
+    const qint32 maxY = count > 0 ? extent.bottom() : 0;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    BlockWriter out(file);
+    out.putRaw(binaryMagic, int(sizeof(binaryMagic)));
+    out.putUInt32(binaryVersion);
+    out.putUInt32(rectCount);
+    out.putUInt32(quint32(count) - rectCount);
+    out.putInt32(minX);
+    out.putInt32(minY);
+    out.putInt32(maxX);
+    out.putInt32(maxY);
+    out.putUInt32(shapes.nextShapeId());
+    out.putUInt32(0); // reserved
+    out.putUInt32(quint32(generation));
+    out.putUInt32(quint32(generation >> 32));
+
+    // One pass over the shapes per column; a cancelled save stops writing
+    // and the uncommitted QSaveFile leaves the target untouched
+    constexpr int passes = 6;
+    qint64 done = 0;
+    bool cancelled = false;
+    auto advance = [&] {
+        if (progress && !cancelled && ++done % progressInterval == 0)
+            cancelled = !progress(done, passes * qint64(count));
+        return !cancelled;
+    };
+
+    shapes.forEachInZOrder([&](int slot) {
+        if (advance())
+            out.putUInt8(quint8(shapes.kindAt(slot)));
+    });
+    shapes.forEachInZOrder([&](int slot) {
+        if (advance())
+            out.putUInt32(shapes.idAt(slot));
+    });
+    for (qint32 (ShapeStore::*column)(int) const :
+         {&ShapeStore::minXAt, &ShapeStore::minYAt, &ShapeStore::maxXAt, &ShapeStore::maxYAt})
+    {
+        shapes.forEachInZOrder([&](int slot) {
+            if (advance())
+                out.putInt32((shapes.*column)(slot));
+        });
+    }
+    if (cancelled)
+        return false;
+
+    if (!out.flush() || !file.commit())
+        return false;
+    if (progress)
+        progress(passes * qint64(count), passes * qint64(count));
+    return true;
+}
+
+} // namespace SceneIO
@@ -0,0 +1,74 @@
+#ifndef SCENEIO_H
+#define SCENEIO_H
+
+#include <QString>
+
+#include <functional>
+
+class ShapeStore;
+
+namespace SceneIO {
+
+enum class Format
+{
+    Json,
+    Binary
+};
+
+// Called every so often with the work done so far out of total (bytes or
+// shapes). Returning false cancels the operation, which then fails without
+// touching the target.
+using Progress = std::function<bool(qint64 done, qint64 total)>;
+
+// Suffix used for the binary scene format; any other suffix saves as JSON.
+constexpr const char *binarySuffix = "vcb";
+
+// Format-agnostic entry points: load() sniffs the file header, save() picks
+// the format from the file suffix. Both leave shapes in an unspecified state
+// on failure, so callers load into a scratch store. generation is the
+// snapshot generation of a binary file, 0 for other formats.
+bool load(const QString &path, ShapeStore &shapes, quint64 *generation = nullptr,
+          const Progress &progress = Progress());
+bool save(const QString &path, const ShapeStore &shapes);
+bool save(const QString &path, const ShapeStore &shapes, Format format, const Progress &progress = Progress());
+Format formatForPath(const QString &path);
+
+// Rewrites a scene file in the format implied by the target suffix.
+bool convert(const QString &from, const QString &to);
+
+// Streams the {"rectangles": [...], "circles": [...]} scene schema straight
+// from a memory-mapped file into shapes, without building a JSON DOM.
+bool loadJson(const QString &path, ShapeStore &shapes);
+bool parseJson(const char *data, qint64 size, ShapeStore &shapes, const Progress &progress = Progress());
+// Writes the same bytes as QJsonDocument's compact form without building a
+// DOM: pool threads format chunks of the scene into a fixed buffer, which is
+// written out in order, so memory stays flat however large the scene.
+bool saveJson(const QString &path, const ShapeStore &shapes, const Progress &progress = Progress());
+
+// Versioned little-endian binary scene:
+//   header   "VCSB", version, rectangle count, circle count, scene bounds
+//            (min x, min y, max x, max y), all 32 bit; since version 2
+//            also next shape id, a reserved word and the snapshot
+//            generation (uint64) that journals are written against
+// Version 3, which saveBinary() writes, stores ShapeStore's own columns,
+// per shape bottom to top, so loading appends them a chunk at a time:
+//   block    kind (uint8)
+//   block    id (uint32)
+//   blocks   min x, min y, max x, max y (int32), one block each; a
+//            circle's box is the square around it
+// Versions 1 and 2 still load, shape by shape:
+//   block    per rectangle: min x, min y, max x, max y (int32)
+//   block    per circle: center x, center y, radius (int32)
+//   block    per shape, bottom to top: kind (uint8), restoring the z-order
+//            across both kinds
+//   block    version 2: per shape, bottom to top: id (uint32)
+// Version 1 files get fresh ids; later versions keep them.
+bool loadBinary(const QString &path, ShapeStore &shapes, quint64 *generation = nullptr);
+bool parseBinary(const char *data, qint64 size, ShapeStore &shapes, quint64 *generation = nullptr,
+                 const Progress &progress = Progress());
+bool saveBinary(const QString &path, const ShapeStore &shapes, quint64 generation = 0,
+                const Progress &progress = Progress());
+
+} // namespace SceneIO
+
+#endif // SCENEIO_H
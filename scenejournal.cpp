@@ -0,0 +1,396 @@
+#include "scenejournal.h"
+#include "asyncsceneio.h"
+#include "profiler.h"
+
+#include <QByteArray>
+#include <QFileInfo>
+#include <QPromise>
+#include <QtConcurrentRun>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char journalMagic[4] = {'V', 'C', 'W', 'L'};
+constexpr quint32 journalVersion = 1;
+constexpr qint64 headerSize = 16;
+constexpr qint64 recordSize = 24;
+
+constexpr quint8 opAdded = 1;
+constexpr quint8 opRemoved = 2;
+
+void encodeRecord(char *out, const ShapeRecord &shape, bool added)
+{
+    out[0] = char(added ? opAdded : opRemoved);
+    out[1] = char(shape.kind);
+    out[2] = out[3] = 0;
+    qToLittleEndian<quint32>(shape.id, out + 4);
+    qToLittleEndian<qint32>(shape.bounds.left(), out + 8);
+    qToLittleEndian<qint32>(shape.bounds.top(), out + 12);
+    qToLittleEndian<qint32>(shape.bounds.right(), out + 16);
+    qToLittleEndian<qint32>(shape.bounds.bottom(), out + 20);
+    qToLittleEndian<quint16>(qChecksum(QByteArrayView(out, recordSize)), out + 2);
+}
+
+bool decodeRecord(const char *in, ShapeRecord &shape, bool &added)
+{
+    char copy[recordSize];
+    std::memcpy(copy, in, recordSize);
+    copy[2] = copy[3] = 0;
+    if (qChecksum(QByteArrayView(copy, recordSize)) != qFromLittleEndian<quint16>(in + 2))
+        return false;
+
+    const quint8 op = quint8(in[0]);
+    const quint8 kind = quint8(in[1]);
+    if ((op != opAdded && op != opRemoved) || kind > quint8(ShapeKind::Circle))
+        return false;
+
+    added = op == opAdded;
+    shape.id = qFromLittleEndian<quint32>(in + 4);
+    shape.kind = ShapeKind(kind);
+    shape.bounds = QRect(QPoint(qFromLittleEndian<qint32>(in + 8), qFromLittleEndian<qint32>(in + 12)),
+                         QPoint(qFromLittleEndian<qint32>(in + 16), qFromLittleEndian<qint32>(in + 20)));
+    return true;
+}
+
+bool readGeneration(const QString &path, quint64 &generation)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray header = file.read(headerSize);
+    if (header.size() != headerSize || std::memcmp(header.constData(), journalMagic, sizeof(journalMagic)) != 0)
+        return false;
+    if (qFromLittleEndian<quint32>(header.constData() + 4) != journalVersion)
+        return false;
+    generation = qFromLittleEndian<quint64>(header.constData() + 8);
+    return true;
+}
+
+// Applies the journal's records up to the first damaged one and returns the
+// length of that valid prefix
+qint64 replay(const QString &path, ShapeStore &shapes)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    const QByteArray data = file.readAll();
+
+    // Replaying is idempotent: ids are never reused for a different shape,
+    // so repeating a prefix of the records does not change the result.
+    // Every new id is handed out by an edit with a record of its own, so an
+    // id beyond one per record past the store's next id is damage.
+    qint64 offset = headerSize;
+    const qint64 idLimit = qint64(shapes.nextShapeId()) + (data.size() - headerSize) / recordSize;
+    ShapeRecord shape;
+    bool added = false;
+    while (offset + recordSize <= data.size() && decodeRecord(data.constData() + offset, shape, added)
+           && qint64(shape.id) <= std::min<qint64>(idLimit, MaxShapeId))
+    {
+        if (added)
+            shapes.restore(shape);
+        else
+            shapes.remove(shape.id);
+        offset += recordSize;
+    }
+    return std::min<qint64>(offset, data.size());
+}
+
+QFuture<bool> readyResult(bool value)
+{
+    QPromise<bool> promise;
+    promise.start();
+    promise.addResult(value);
+    promise.finish();
+    return promise.future();
+}
+
+// Waits until the OS has what was written to handle on the disk, so the
+// data outlives a power cut and not just a crash. Safe to run on another
+// thread while more is written to the same handle.
+bool syncHandle(int handle)
+{
+#if defined(Q_OS_WIN)
+    return _commit(handle) == 0;
+#elif defined(Q_OS_DARWIN)
+    // fsync() on macOS leaves the data in the drive's cache
+    return fcntl(handle, F_FULLFSYNC) == 0 || fsync(handle) == 0;
+#elif defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+    return fdatasync(handle) == 0;
+#else
+    return fsync(handle) == 0;
+#endif
+}
+
+bool syncToDisk(QFile &file)
+{
+    return file.flush() && syncHandle(file.handle());
+}
+
+// Makes a file just created in dir, or renamed into it, survive a power
+// cut. Windows keeps directory entries durable by itself.
+bool syncDirectory(const QString &dir)
+{
+#if defined(Q_OS_WIN)
+    Q_UNUSED(dir);
+    return true;
+#else
+    const int fd = ::open(QFile::encodeName(dir).constData(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    const bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Moves the records of one journal to the end of another
+bool appendRecords(const QString &from, const QString &to)
+{
+    QFile source(from);
+    if (!source.open(QIODevice::ReadOnly))
+        return !source.exists();
+    source.seek(headerSize);
+    QByteArray records = source.readAll();
+    records.truncate(records.size() - records.size() % recordSize);
+
+    QFile target(to);
+    if (!target.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    return target.write(records) == records.size() && syncToDisk(target);
+}
+
+} // namespace
+
+SceneJournal::SceneJournal(const QString &snapshotPath)
+    : snapshot(snapshotPath)
+{
+}
+
+SceneJournal::~SceneJournal()
+{
+    waitForCompaction();
+    closeJournal();
+}
+
+bool SceneJournal::recover(const QString &path, ShapeStore &shapes, quint64 *generation, bool *clean,
+                           const SceneIO::Progress &progress)
+{
+    quint64 current = 0;
+    if (!SceneIO::load(path, shapes, &current, progress))
+        return false;
+
+    bool intact = true;
+    quint64 journalGeneration = 0;
+
+    // A compaction was interrupted; the old journal counts only if the new
+    // snapshot never made it to disk
+    const QString oldPath = path + ".wal.old";
+    if (QFile::exists(oldPath))
+    {
+        intact = false;
+        if (readGeneration(oldPath, journalGeneration) && journalGeneration == current)
+        {
+            replay(oldPath, shapes);
+            ++current;
+        }
+    }
+
+    const QString walPath = path + ".wal";
+    if (QFile::exists(walPath))
+    {
+        if (readGeneration(walPath, journalGeneration) && journalGeneration == current)
+            intact &= replay(walPath, shapes) == QFile(walPath).size();
+        else
+            intact = false; // left over from an older snapshot
+    }
+
+    if (generation)
+        *generation = current;
+    if (clean)
+        *clean = intact;
+    return true;
+}
+
+bool SceneJournal::resume(quint64 journalGeneration)
+{
+    waitForCompaction();
+    closeJournal();
+    generation = journalGeneration;
+    journal.setFileName(journalPath());
+    if (!journal.exists())
+        return startJournal();
+
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    pending = int((journal.size() - headerSize) / recordSize);
+    broken = false;
+    return true;
+}
+
+bool SceneJournal::reset(const ShapeStore &shapes)
+{
+    waitForCompaction();
+    closeJournal();
+
+    // Newer than any journal on disk, so none of them is replayed on top
+    const quint64 next = newestGeneration() + 1;
+    if (!SceneIO::saveBinary(snapshot, shapes, next))
+    {
+        journal.open(QIODevice::WriteOnly | QIODevice::Append);
+        return false;
+    }
+
+    generation = next;
+    QFile::remove(oldJournalPath());
+    return startJournal();
+}
+
+bool SceneJournal::append(const ShapeRecord &shape, bool added)
+{
+    if (!journal.isOpen())
+        return false;
+
+    char record[recordSize];
+    encodeRecord(record, shape, added);
+    if (journal.write(record, recordSize) != recordSize)
+    {
+        broken = true;
+        return false;
+    }
+    ++pending;
+    return true;
+}
+
+bool SceneJournal::flush()
+{
+    if (syncing.isFinished() && syncing.resultCount() > 0 && !syncing.result())
+        broken = true;
+    if (failed() || !journal.flush())
+    {
+        broken = true;
+        return false;
+    }
+    unsynced = true;
+    return true;
+}
+
+bool SceneJournal::syncInBackground()
+{
+    if (failed())
+        return false;
+    if (!unsynced || syncing.isRunning())
+        return true;
+
+    unsynced = false;
+    syncing = QtConcurrent::run([handle = journal.handle()] { return syncHandle(handle); });
+    return true;
+}
+
+QFuture<bool> SceneJournal::compactInBackground(const ShapeStore &shapes)
+{
+    waitForCompaction();
+    const auto failed = [this] {
+        journal.open(QIODevice::WriteOnly | QIODevice::Append);
+        return readyResult(false);
+    };
+    if (!closeJournal())
+    {
+        broken = true; // records that may not have reached the disk
+        return failed();
+    }
+    if (QFile::exists(oldJournalPath()))
+    {
+        // The previous compaction failed, so the old journal is still needed:
+        // carry this one's records over and keep the generation
+        if (!appendRecords(journalPath(), oldJournalPath()))
+            return failed();
+        QFile::remove(journalPath());
+    }
+    else
+    {
+        if (!QFile::rename(journalPath(), oldJournalPath()))
+            return failed();
+        ++generation;
+    }
+    if (!startJournal())
+    {
+        // Put the previous journal back in place, so edits go on where they
+        // left off and the generation matches the snapshot on disk again
+        journal.close();
+        QFile::remove(journalPath());
+        quint64 previous = 0;
+        if (readGeneration(oldJournalPath(), previous) && QFile::rename(oldJournalPath(), journalPath()))
+        {
+            generation = previous;
+            resume(generation);
+        }
+        return readyResult(false);
+    }
+
+    // The copy is a snapshot that shares the store's chunks; edits made while
+    // it is written copy only the chunks they touch
+    compaction = QtConcurrent::run([copy = shapes, path = snapshot, oldPath = oldJournalPath(),
+                                    next = generation](QPromise<bool> &promise) {
+        PROFILE_SCOPE("compact");
+        const bool ok = SceneIO::saveBinary(path, copy, next, AsyncSceneIO::reportTo(promise));
+        if (ok)
+            QFile::remove(oldPath);
+        promise.addResult(ok);
+    });
+    return compaction;
+}
+
+void SceneJournal::waitForCompaction()
+{
+    compaction.waitForFinished();
+}
+
+bool SceneJournal::closeJournal()
+{
+    syncing.waitForFinished();
+    bool ok = syncing.resultCount() == 0 || syncing.result();
+    if (journal.isOpen())
+        ok &= syncToDisk(journal);
+    syncing = QFuture<bool>();
+    unsynced = false;
+    journal.close();
+    return ok;
+}
+
+bool SceneJournal::startJournal()
+{
+    closeJournal();
+    journal.setFileName(journalPath());
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    char header[headerSize];
+    std::memcpy(header, journalMagic, sizeof(journalMagic));
+    qToLittleEndian<quint32>(journalVersion, header + 4);
+    qToLittleEndian<quint64>(generation, header + 8);
+    pending = 0;
+    broken = journal.write(header, headerSize) != headerSize || !syncToDisk(journal)
+             || !syncDirectory(QFileInfo(journalPath()).absolutePath());
+    return !broken;
+}
+
+quint64 SceneJournal::newestGeneration() const
+{
+    quint64 newest = generation;
+    quint64 onDisk = 0;
+    if (readGeneration(journalPath(), onDisk))
+        newest = std::max(newest, onDisk);
+    if (readGeneration(oldJournalPath(), onDisk))
+        newest = std::max(newest, onDisk);
+    return newest;
+}
@@ -0,0 +1,98 @@
+#ifndef SCENEJOURNAL_H
+#define SCENEJOURNAL_H
+
+#include <QFile>
+#include <QFuture>
+#include <QString>
+
+#include "sceneio.h"
+#include "shapestore.h"
+
+// Append-only write-ahead log of shape additions and removals, kept next to
+// a binary scene snapshot so that an edit costs one small record instead of
+// a full save, and a crash loses nothing.
+//
+// Files, for snapshot "scene.vcb":
+//   scene.vcb          binary snapshot (version 2 or later), tagged with generation G
+//   scene.vcb.wal      edits on top of generation G
+//   scene.vcb.wal.old  only while compacting: the previous journal, on top of
+//                      generation G - 1
+//
+// Journal layout, little-endian:
+//   header   "VCWL", version (uint32), generation (uint64)
+//   record   op (uint8: 1 added, 2 removed), kind (uint8), CRC-16 of the
+//            record with this field zeroed (uint16), id (uint32), min x,
+//            min y, max x, max y (int32)
+// A torn last record fails its checksum and is dropped on recovery.
+//
+// Compaction rotates the journal, then writes the snapshot and deletes the
+// old journal on a background thread while edits go to the new journal.
+// Every step leaves a file set that recover() turns back into the scene.
+class SceneJournal
+{
+public:
+    explicit SceneJournal(const QString &snapshotPath);
+    ~SceneJournal();
+
+    SceneJournal(const SceneJournal &) = delete;
+    SceneJournal &operator=(const SceneJournal &) = delete;
+
+    const QString &snapshotPath() const { return snapshot; }
+
+    // Loads the snapshot at path and replays its journals. generation is the
+    // generation new edits belong to; clean tells whether resume() may append
+    // to the journal as it is. Works on any scene file; only binary snapshots
+    // have journals. progress covers loading the snapshot.
+    static bool recover(const QString &path, ShapeStore &shapes, quint64 *generation, bool *clean,
+                        const SceneIO::Progress &progress = SceneIO::Progress());
+
+    // Continues the journal after a clean recover()
+    bool resume(quint64 generation);
+    // Writes shapes as a new snapshot and starts an empty journal on it
+    bool reset(const ShapeStore &shapes);
+
+    // Records are buffered until flush(), which hands them to the OS: from
+    // then on they survive the application crashing. syncInBackground()
+    // waits on a worker thread until the OS has everything flushed so far on
+    // the disk (fdatasync, F_FULLFSYNC on macOS, _commit on Windows), which
+    // also covers a power cut. Flushing is cheap and syncing is not, so a
+    // caller flushes every edit and syncs whole groups of them; a sync still
+    // running leaves the records flushed since for the next call. Closing
+    // the journal always syncs first.
+    bool append(const ShapeRecord &shape, bool added);
+    bool flush();
+    bool syncInBackground();
+    bool hasUnsyncedRecords() const { return unsynced; }
+    int pendingRecords() const { return pending; }
+
+    // A write, flush, sync or journal restart failed, and every append() and
+    // flush() fails from then on: edits are no longer logged until reset()
+    // starts over from a full snapshot
+    bool failed() const { return broken || !journal.isOpen(); }
+
+    // Folds everything journaled so far into a new snapshot of shapes on the
+    // QtConcurrent pool, waiting for any compaction still running first. The
+    // future reports progress; cancelling it is safe, as the old journal then
+    // stays in place. The result is false when the snapshot was not written.
+    QFuture<bool> compactInBackground(const ShapeStore &shapes);
+    bool isCompacting() const { return compaction.isRunning(); }
+    void waitForCompaction();
+
+private:
+    QString journalPath() const { return snapshot + ".wal"; }
+    QString oldJournalPath() const { return snapshot + ".wal.old"; }
+    bool startJournal();
+    bool closeJournal();
+    quint64 newestGeneration() const;
+
+    QString snapshot;
+    QFile journal;
+    quint64 generation = 0;
+    int pending = 0;
+    bool broken = false;
+    bool unsynced = false; // flushed records no sync has started on yet
+    QFuture<bool> syncing;
+    QFuture<bool> compaction;
+};
+
+#endif // SCENEJOURNAL_H
@@ -0,0 +1,323 @@
+#include "scenerenderer.h"
+
+#include <QPainter>
+#include <QPainterPath>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const QColor circleFill(120, 180, 220, 160);
+const QColor rectFill(160, 200, 140, 180);
+// A sub-pixel shape is mostly fill, so its splat uses the opaque fill colour
+const QColor circleSplat(120, 180, 220);
+const QColor rectSplat(160, 200, 140);
+
+constexpr int minSegments = 8;
+constexpr int maxSegments = 32;
+
+// Unit circle vertices for every polygon size the LOD pass uses
+const QVector<QPointF> &unitCircle(int segments)
+{
+    static const QVector<QVector<QPointF>> tables = [] {
+        QVector<QVector<QPointF>> t(maxSegments + 1);
+        for (int n = minSegments; n <= maxSegments; ++n)
+        {
+            t[n].reserve(n);
+            for (int i = 0; i < n; ++i)
+            {
+                const qreal a = 2 * M_PI * i / n;
+                t[n].append(QPointF(std::cos(a), std::sin(a)));
+            }
+        }
+        return t;
+    }();
+    return tables.at(segments);
+}
+
+// Draw style of one shape after the LOD decision. Consecutive shapes with
+// the same style form a run that is submitted with a single pen/brush setup.
+enum class Style : quint8
+{
+    RectSplat,
+    CircleSplat,
+    Rect,
+    CirclePolygon,
+    Ellipse
+};
+
+// Per-thread scratch space, reused across frames so the draw loop does not
+// allocate once the buffers have grown to the working-set size
+struct DrawBuffers
+{
+    QVector<int> shapeSlots;
+    QVector<qint32> left; // gathered minX / maxY columns of the shapes drawn
+    QVector<qint32> top;
+    QVector<double> x;    // painter-space top-left corners
+    QVector<double> y;
+    QVector<QRectF> bounds; // painter-space bounding box per shape
+    QVector<Style> styles;
+    QVector<QRectF> grouped; // bounds regrouped by style
+    QVector<QPointF> points;
+    QPainterPath path;
+};
+
+DrawBuffers &drawBuffers()
+{
+    thread_local DrawBuffers buffers;
+    return buffers;
+}
+
+// One device pixel wide at every zoom, as the shapes are drawn in world units
+QPen outlinePen()
+{
+    QPen pen(Qt::black, 1);
+    pen.setCosmetic(true);
+    return pen;
+}
+
+void drawRun(QPainter &painter, Style style, const QRectF *bounds, int count, DrawBuffers &buffers, qreal scale)
+{
+    QVector<QPointF> &points = buffers.points;
+    QPainterPath &path = buffers.path;
+    switch (style)
+    {
+    case Style::RectSplat:
+    case Style::CircleSplat:
+    {
+        points.clear();
+        for (int i = 0; i < count; ++i)
+            points.append(bounds[i].center());
+        QPen pen(style == Style::RectSplat ? rectSplat : circleSplat, 1);
+        pen.setCosmetic(true);
+        painter.setPen(pen);
+        painter.drawPoints(points.constData(), count);
+        painter.setPen(outlinePen());
+        break;
+    }
+    case Style::Rect:
+        painter.setBrush(rectFill);
+        painter.drawRects(bounds, count);
+        break;
+    case Style::CirclePolygon:
+    {
+        // One path for the whole run: where these few-pixel circles overlap
+        // their translucent fill is applied once rather than once per circle
+        path.clear();
+        path.setFillRule(Qt::WindingFill);
+        for (int i = 0; i < count; ++i)
+        {
+            const QPointF center = bounds[i].center();
+            const qreal r = bounds[i].width() / 2;
+            const int n = qBound(minSegments, qCeil(r * scale * 2), maxSegments);
+            const QVector<QPointF> &unit = unitCircle(n);
+            path.moveTo(center + unit.at(0) * r);
+            for (int k = 1; k < n; ++k)
+                path.lineTo(center + unit.at(k) * r);
+            path.closeSubpath();
+        }
+        painter.setBrush(circleFill);
+        painter.drawPath(path);
+        break;
+    }
+    case Style::Ellipse:
+        // Large enough that overlaps show, so each keeps its own blending;
+        // the fill of a shape this size costs more than its call anyway
+        painter.setBrush(circleFill);
+        for (int i = 0; i < count; ++i)
+            painter.drawEllipse(bounds[i]);
+        break;
+    }
+}
+
+// The smallest 1, 2 or 5 times a power of ten that is at least minimum
+qreal tickStep(qreal minimum)
+{
+    const qreal power = std::pow(10.0, std::floor(std::log10(minimum)));
+    for (qreal factor : {1.0, 2.0, 5.0})
+    {
+        if (factor * power >= minimum)
+            return factor * power;
+    }
+    return 10 * power;
+}
+
+} // namespace
+
+namespace SceneRenderer {
+
+void drawShapes(QPainter &painter, const ShapeStore &shapes, const QVector<ShapeId> &ids,
+                const QPoint &origin, const LodSettings &lod)
+{
+    const int count = int(ids.size());
+    if (count == 0)
+        return;
+
+    // World units to device pixels; world and device axes are never rotated
+    const qreal scale = std::sqrt(qAbs(painter.deviceTransform().determinant()));
+    const qreal pointLimit = lod.enabled && scale > 0 ? lod.pointSize / scale : 0;
+    const qreal polygonLimit = lod.enabled && scale > 0 ? lod.polygonRadius / scale : 0;
+
+    DrawBuffers &buffers = drawBuffers();
+    buffers.shapeSlots.resize(count);
+    buffers.bounds.resize(count);
+    buffers.styles.resize(count);
+    int *shapeSlots = buffers.shapeSlots.data();
+    QRectF *bounds = buffers.bounds.data();
+    Style *styles = buffers.styles.data();
+    for (int i = 0; i < count; ++i)
+        shapeSlots[i] = shapes.slotOf(ids.at(i));
+
+    // Pass 1: top-left corners into painter space through the transform
+    // kernel. When most of the store is drawn it runs over the store's own
+    // column runs and each shape picks up its slot's result; a close-up
+    // gathers the few visible shapes' columns instead of touching them all.
+    const bool wholeStore = qint64(count) * 2 >= shapes.size();
+    const int corners = wholeStore ? shapes.size() : count;
+    buffers.x.resize(corners);
+    buffers.y.resize(corners);
+    double *x = buffers.x.data();
+    double *y = buffers.y.data();
+    if (wholeStore)
+    {
+        for (int run = 0; run < shapes.runCount(); ++run)
+        {
+            const GeometryKernels::Boxes boxes = shapes.boxRun(run);
+            const int first = run * ShapeStore::runLength;
+            GeometryKernels::transform(boxes.minX, boxes.maxY, boxes.count, 1, origin.x(), -1, origin.y(),
+                                       x + first, y + first);
+        }
+    }
+    else
+    {
+        buffers.left.resize(count);
+        buffers.top.resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            buffers.left[i] = shapes.minXAt(shapeSlots[i]);
+            buffers.top[i] = shapes.maxYAt(shapeSlots[i]);
+        }
+        GeometryKernels::transform(buffers.left.constData(), buffers.top.constData(), count, 1, origin.x(), -1,
+                                   origin.y(), x, y);
+    }
+
+    // Then sizes and the LOD style of every shape
+    for (int i = 0; i < count; ++i)
+    {
+        const int slot = shapeSlots[i];
+        const int corner = wholeStore ? slot : i;
+        const qint32 w = shapes.maxXAt(slot) - shapes.minXAt(slot);
+        const qint32 h = shapes.maxYAt(slot) - shapes.minYAt(slot);
+        const bool circle = shapes.kindAt(slot) == ShapeKind::Circle;
+
+        // A circle's box spans 2r; a rectangle covers one more unit than its
+        // corner difference, matching QRect's inclusive right/bottom edges
+        const int extent = circle ? 0 : 1;
+        bounds[i] = QRectF(x[corner], y[corner], w + extent, h + extent);
+
+        if (qMax(w + extent, h + extent) < pointLimit)
+            styles[i] = circle ? Style::CircleSplat : Style::RectSplat;
+        else if (circle)
+            styles[i] = w / 2 <= polygonLimit ? Style::CirclePolygon : Style::Ellipse;
+        else
+            styles[i] = Style::Rect;
+    }
+
+    painter.setPen(outlinePen());
+    if (!lod.groupStyles)
+    {
+        // Pass 2: one submission per run of equal style, which keeps z-order
+        int start = 0;
+        for (int i = 1; i <= count; ++i)
+        {
+            if (i < count && styles[i] == styles[start])
+                continue;
+            drawRun(painter, styles[start], bounds + start, i - start, buffers, scale);
+            start = i;
+        }
+        return;
+    }
+
+    // Pass 2: a stable counting sort by style, then one submission per
+    // style, bottom to top within it
+    constexpr int styleCount = int(Style::Ellipse) + 1;
+    int offsets[styleCount + 1] = {};
+    for (int i = 0; i < count; ++i)
+        ++offsets[int(styles[i]) + 1];
+    for (int s = 0; s < styleCount; ++s)
+        offsets[s + 1] += offsets[s];
+    buffers.grouped.resize(count);
+    QRectF *grouped = buffers.grouped.data();
+    int next[styleCount];
+    std::copy(offsets, offsets + styleCount, next);
+    for (int i = 0; i < count; ++i)
+        grouped[next[int(styles[i])]++] = bounds[i];
+    for (int s = 0; s < styleCount; ++s)
+    {
+        if (offsets[s + 1] > offsets[s])
+            drawRun(painter, Style(s), grouped + offsets[s], offsets[s + 1] - offsets[s], buffers, scale);
+    }
+}
+
+QPoint viewOrigin(const QSize &viewSize)
+{
+    return QPoint(40, viewSize.height() - 40);
+}
+
+void drawBackground(QPainter &painter, const QRect &view, const QPoint &origin, qreal scale)
+{
+    painter.fillRect(view, QColor(245, 245, 245));
+
+    // Highlight A4 area (210x297) in world coords
+    painter.setPen(QPen(QColor(120, 120, 120), 1, Qt::DashLine));
+    painter.setBrush(QColor(230, 230, 230, 80));
+    const QRectF a4Rect(origin.x(), origin.y() - 210 * scale, 297 * scale, 210 * scale);
+    painter.drawRect(a4Rect);
+}
+
+void drawAxes(QPainter &painter, const QRect &view, const QPoint &origin, qreal scale)
+{
+    // Draw simple X/Y axes from the anchor point
+    const int margin = 20;
+    const QPoint &o = origin;
+    const QPoint xEnd(view.right() + 1 - margin, o.y());
+    const QPoint yEnd(o.x(), view.top() + margin);
+
+    painter.setPen(QPen(Qt::darkGray, 2));
+    painter.drawLine(o, xEnd);
+    painter.drawLine(o, yEnd);
+
+    // Ticks at least 100 px apart, only those inside the view
+    const qreal step = tickStep(100 / scale);
+    const int tickLen = 6;
+    for (qint64 k = qMax<qint64>(1, qCeil((view.left() - o.x()) / scale / step)); ; ++k)
+    {
+        const int x = qRound(o.x() + k * step * scale);
+        if (x > xEnd.x())
+            break;
+        painter.drawLine(QPoint(x, o.y() - tickLen), QPoint(x, o.y() + tickLen));
+        painter.drawText(QPoint(x - 12, o.y() - 8), QString::number(k * step));
+    }
+    for (qint64 k = qMax<qint64>(1, qCeil((o.y() - view.bottom()) / scale / step)); ; ++k)
+    {
+        const int y = qRound(o.y() - k * step * scale);
+        if (y < yEnd.y())
+            break;
+        painter.drawLine(QPoint(o.x() - tickLen, y), QPoint(o.x() + tickLen, y));
+        painter.drawText(QPoint(o.x() + 8, y + 4), QString::number(k * step));
+    }
+
+    // Arrow heads
+    painter.drawLine(xEnd, xEnd + QPoint(-8, -5));
+    painter.drawLine(xEnd, xEnd + QPoint(-8, 5));
+    painter.drawLine(yEnd, yEnd + QPoint(-5, -8));
+    painter.drawLine(yEnd, yEnd + QPoint(5, -8));
+
+    painter.setPen(Qt::darkGray);
+    painter.drawText(xEnd + QPoint(-15, -8), "X");
+    painter.drawText(yEnd + QPoint(8, -12), "Y");
+}
+
+} // namespace SceneRenderer
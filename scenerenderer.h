@@ -0,0 +1,50 @@
+#ifndef SCENERENDERER_H
+#define SCENERENDERER_H
+
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+
+#include "shapestore.h"
+
+class QPainter;
+
+namespace SceneRenderer {
+
+// Level-of-detail thresholds, in device pixels. Shapes whose on-device
+// extent is below pointSize are splatted as single batched points; circles
+// with a device radius up to polygonRadius are drawn as short polygons
+// instead of antialiased ellipses.
+struct LodSettings
+{
+    bool enabled = true;
+    qreal pointSize = 1.5;
+    qreal polygonRadius = 6.0;
+    // Draw all shapes of one style in a single batch, bottom to top within
+    // the style, rather than runs of equal style in exact z-order, which
+    // mixed scenes break into runs of one. The trade-off: where shapes of
+    // different styles overlap, the style drawn later ends up on top and
+    // the translucent fills blend in that order.
+    bool groupStyles = true;
+};
+
+// Draws the given shapes, bottom to top in list order (see groupStyles). origin is where world (0, 0) lands
+// in the painter's logical coordinates; world y grows upwards. The painter's
+// device transform decides which level of detail each shape gets.
+void drawShapes(QPainter &painter, const ShapeStore &shapes, const QVector<ShapeId> &ids,
+                const QPoint &origin, const LodSettings &lod = LodSettings());
+
+// Where world (0, 0) lands in a view of the given size: the bottom-left
+// corner, inset by the axis margin.
+QPoint viewOrigin(const QSize &viewSize);
+
+// Canvas chrome shared by the widget, printing and headless rendering. The
+// background fills view and outlines the A4 sheet; the axes are drawn on top
+// of everything else. scale is view pixels per world unit.
+void drawBackground(QPainter &painter, const QRect &view, const QPoint &origin, qreal scale = 1);
+void drawAxes(QPainter &painter, const QRect &view, const QPoint &origin, qreal scale = 1);
+
+} // namespace SceneRenderer
+
+#endif // SCENERENDERER_H
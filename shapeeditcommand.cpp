@@ -0,0 +1,90 @@
+#include "shapeeditcommand.h"
+#include "canvas.h"
+
+#include <QDateTime>
+
+ShapeEditCommand::ShapeEditCommand(Canvas *canvas, const QString &text, int mergeInterval)
+    : QUndoCommand(text)
+    , canvas(canvas)
+    , timestamp(QDateTime::currentMSecsSinceEpoch())
+    , mergeInterval(mergeInterval)
+{
+}
+
+ShapeEditCommand::~ShapeEditCommand()
+{
+    if (counted)
+        canvas->undoBytes -= bytes();
+}
+
+ShapeEditCommand *ShapeEditCommand::clone() const
+{
+    auto *copy = new ShapeEditCommand(canvas, text(), mergeInterval);
+    copy->changes = changes;
+    copy->timestamp = timestamp;
+    copy->restored = true;
+    return copy;
+}
+
+void ShapeEditCommand::undo()
+{
+    apply(true);
+}
+
+void ShapeEditCommand::redo()
+{
+    if (applied)
+    {
+        applied = false;
+        counted = true;
+        canvas->undoBytes += bytes();
+        return;
+    }
+    apply(false);
+}
+
+void ShapeEditCommand::apply(bool reverse)
+{
+    // Consecutive additions, or removals, go to the canvas as one batch
+    QVector<ShapeRecord> run;
+    bool runAdds = false;
+    const auto flush = [&] {
+        if (runAdds)
+            canvas->insertShapes(run);
+        else
+            canvas->eraseShapes(run);
+        run.clear();
+    };
+
+    for (int i = 0; i < changes.size(); ++i)
+    {
+        const Change &change = changes.at(reverse ? changes.size() - 1 - i : i);
+        const bool adds = change.added != reverse;
+        if (!run.isEmpty() && adds != runAdds)
+            flush();
+        runAdds = adds;
+        run.append(change.shape);
+    }
+    if (!run.isEmpty())
+        flush();
+    canvas->finishEdit();
+}
+
+int ShapeEditCommand::id() const
+{
+    return mergeInterval > 0 ? 1 : -1;
+}
+
+bool ShapeEditCommand::mergeWith(const QUndoCommand *other)
+{
+    // Repeats of the same kind of edit in quick succession undo together
+    const auto *next = static_cast<const ShapeEditCommand *>(other);
+    if (next->restored || next->text() != text() || next->timestamp - timestamp > mergeInterval)
+        return false;
+
+    // next leaves the total when it is deleted, its changes stay here
+    canvas->undoBytes += qint64(next->changes.size()) * qint64(sizeof(Change));
+    changes += next->changes;
+    timestamp = next->timestamp;
+    return true;
+}
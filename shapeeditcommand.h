@@ -0,0 +1,58 @@
+#ifndef SHAPEEDITCOMMAND_H
+#define SHAPEEDITCOMMAND_H
+
+#include <QUndoCommand>
+#include <QVector>
+
+#include "shapestore.h"
+
+class Canvas;
+
+// One undo step: the ordered list of shapes added to and removed from the
+// canvas. Each change keeps only the shape's id, kind and bounds, so memory
+// grows with the number of shapes touched, not with the scene size.
+//
+// The canvas applies an edit before recording it, so the redo() that
+// QUndoStack::push() issues is skipped. That first redo() also adds the
+// command's bytes() to the canvas's undo history total, which it leaves
+// again when deleted.
+class ShapeEditCommand : public QUndoCommand
+{
+public:
+    ShapeEditCommand(Canvas *canvas, const QString &text, int mergeInterval);
+    ~ShapeEditCommand() override;
+
+    // An applied copy, for rebuilding the history; never merged into the
+    // command pushed before it
+    ShapeEditCommand *clone() const;
+
+    void recordAdded(const ShapeRecord &shape) { changes.append({shape, true}); }
+    void recordRemoved(const ShapeRecord &shape) { changes.append({shape, false}); }
+    bool isEmpty() const { return changes.isEmpty(); }
+    // Memory held for the undo history
+    qint64 bytes() const { return qint64(sizeof(ShapeEditCommand)) + qint64(changes.size()) * qint64(sizeof(Change)); }
+
+    void undo() override;
+    void redo() override;
+    int id() const override;
+    bool mergeWith(const QUndoCommand *other) override;
+
+private:
+    void apply(bool reverse);
+
+    struct Change
+    {
+        ShapeRecord shape;
+        bool added;
+    };
+
+    Canvas *canvas;
+    QVector<Change> changes;
+    qint64 timestamp;  // ms, for merging edits made in quick succession
+    int mergeInterval; // ms, 0 never merges
+    bool applied = true;
+    bool counted = false; // in the canvas's undo history total
+    bool restored = false;
+};
+
+#endif // SHAPEEDITCOMMAND_H
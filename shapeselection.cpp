@@ -0,0 +1,47 @@
+#include "shapeselection.h"
+
+#include <QtAlgorithms>
+
+void ShapeSelection::clear()
+{
+    words.clear();
+    count = 0;
+}
+
+bool ShapeSelection::contains(ShapeId id) const
+{
+    const int word = int(id / 64);
+    return word < words.size() && (words.at(word) >> (id % 64)) & 1;
+}
+
+void ShapeSelection::insert(ShapeId id)
+{
+    if (id == InvalidShapeId || contains(id))
+        return;
+    const int word = int(id / 64);
+    if (word >= words.size())
+        words.resize(word + 1, 0);
+    words[word] |= quint64(1) << (id % 64);
+    ++count;
+}
+
+void ShapeSelection::remove(ShapeId id)
+{
+    if (!contains(id))
+        return;
+    words[int(id / 64)] &= ~(quint64(1) << (id % 64));
+    --count;
+}
+
+QVector<ShapeId> ShapeSelection::ids() const
+{
+    QVector<ShapeId> result;
+    result.reserve(count);
+    for (int word = 0; word < words.size(); ++word)
+    {
+        // Visit only the set bits, lowest first
+        for (quint64 bits = words.at(word); bits != 0; bits &= bits - 1)
+            result.append(ShapeId(word) * 64 + ShapeId(qCountTrailingZeroBits(bits)));
+    }
+    return result;
+}
@@ -0,0 +1,29 @@
+#ifndef SHAPESELECTION_H
+#define SHAPESELECTION_H
+
+#include <QVector>
+
+#include "shapestore.h"
+
+// A set of shape ids kept as a bitset indexed by id: membership tests and
+// updates are O(1), and listing the set scans one bit per id handed out.
+class ShapeSelection
+{
+public:
+    void clear();
+    bool contains(ShapeId id) const;
+    void insert(ShapeId id);
+    void remove(ShapeId id);
+
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+
+    // Selected ids, ascending (bottom to top)
+    QVector<ShapeId> ids() const;
+
+private:
+    QVector<quint64> words;
+    int count = 0;
+};
+
+#endif // SHAPESELECTION_H
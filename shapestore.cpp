@@ -0,0 +1,318 @@
+#include "shapestore.h"
+
+#include <algorithm>
+
+ShapeId ShapeStore::addRectangle(const QRect &rect)
+{
+    const QRect r = rect.normalized();
+    return append(ShapeKind::Rectangle, r.left(), r.top(), r.right(), r.bottom());
+}
+
+ShapeId ShapeStore::addCircle(const QPoint &center, int radius)
+{
+    return append(ShapeKind::Circle, center.x() - radius, center.y() - radius,
+                  center.x() + radius, center.y() + radius);
+}
+
+ShapeId ShapeStore::addShapes(const ShapeSpec *shapes, int count)
+{
+    reserve(size() + count);
+    slotById.resize(int(nextId) + count, -1);
+
+    const ShapeId first = nextId;
+    for (int i = 0; i < count; ++i)
+    {
+        const QRect &b = shapes[i].bounds;
+        append(shapes[i].kind, b.left(), b.top(), b.right(), b.bottom());
+    }
+    return first;
+}
+
+ShapeId ShapeStore::append(ShapeKind kind, qint32 x0, qint32 y0, qint32 x1, qint32 y1)
+{
+    const ShapeId id = nextId++;
+    if (slotById.size() <= int(id))
+        slotById.resize(int(id) + 1, -1);
+    appendSlot(id, kind, x0, y0, x1, y1);
+    zOrder.append(id);
+    return id;
+}
+
+bool ShapeStore::restore(const ShapeRecord &record)
+{
+    // Any id not currently in use; ids past the last one handed out are
+    // reserved so that later additions never collide with them
+    if (record.id == InvalidShapeId || record.id > MaxShapeId || contains(record.id))
+        return false;
+    reserveIds(record.id + 1);
+
+    const QRect &b = record.bounds;
+    appendSlot(record.id, record.kind, b.left(), b.top(), b.right(), b.bottom());
+
+    // The id may still sit in the z-order as a hole; otherwise it goes back
+    // between its old neighbours
+    const auto it = std::lower_bound(zOrder.begin(), zOrder.end(), record.id);
+    if (it != zOrder.end() && *it == record.id)
+        --zOrderHoles;
+    else
+        zOrder.insert(it - zOrder.begin(), record.id);
+    return true;
+}
+
+bool ShapeStore::appendColumns(const ShapeId *ids, const ShapeKind *kindColumn, const qint32 *x0,
+                               const qint32 *y0, const qint32 *x1, const qint32 *y1, int count)
+{
+    ShapeId previous = nextId - 1;
+    for (int i = 0; i < count; ++i)
+    {
+        if (ids[i] <= previous || ids[i] > MaxShapeId)
+            return false;
+        previous = ids[i];
+    }
+    if (count == 0)
+        return true;
+
+    // Ids from nextId on are in neither the id table nor the z-order, so
+    // both only grow at the end
+    reserveIds(previous + 1);
+    const int first = slotIds.size();
+    for (int i = 0; i < count; ++i)
+        slotById.set(int(ids[i]), first + i);
+    slotIds.append(ids, count);
+    kinds.append(kindColumn, count);
+    minX.append(x0, count);
+    minY.append(y0, count);
+    maxX.append(x1, count);
+    maxY.append(y1, count);
+    zOrder.append(ids, count);
+    return true;
+}
+
+bool ShapeStore::reserveIds(ShapeId next)
+{
+    if (next > MaxShapeId + 1)
+        return false;
+    if (next > nextId)
+    {
+        slotById.resize(int(next), -1);
+        nextId = next;
+    }
+    return true;
+}
+
+void ShapeStore::appendSlot(ShapeId id, ShapeKind kind, qint32 x0, qint32 y0, qint32 x1, qint32 y1)
+{
+    slotById.set(int(id), slotIds.size());
+    slotIds.append(id);
+    kinds.append(kind);
+    minX.append(x0);
+    minY.append(y0);
+    maxX.append(x1);
+    maxY.append(y1);
+}
+
+bool ShapeStore::remove(ShapeId id)
+{
+    const int slot = slotOf(id);
+    if (slot < 0)
+        return false;
+
+    // Swap-remove: move the last slot into the hole and retarget its id
+    const int last = slotIds.size() - 1;
+    if (slot != last)
+    {
+        slotIds.set(slot, slotIds.at(last));
+        kinds.set(slot, kinds.at(last));
+        minX.set(slot, minX.at(last));
+        minY.set(slot, minY.at(last));
+        maxX.set(slot, maxX.at(last));
+        maxY.set(slot, maxY.at(last));
+        slotById.set(int(slotIds.at(slot)), slot);
+    }
+    slotIds.removeLast();
+    kinds.removeLast();
+    minX.removeLast();
+    minY.removeLast();
+    maxX.removeLast();
+    maxY.removeLast();
+    slotById.set(int(id), -1);
+
+    // The z-order entry is left in place and skipped until the next compaction
+    if (++zOrderHoles > 64 && zOrderHoles * 2 > zOrder.size())
+        compactZOrder();
+    return true;
+}
+
+int ShapeStore::removeMany(const QVector<ShapeId> &ids)
+{
+    QVector<bool> removed(size(), false);
+    int count = 0;
+    for (ShapeId id : ids)
+    {
+        const int slot = slotOf(id);
+        if (slot < 0)
+            continue;
+        removed[slot] = true;
+        slotById.set(int(id), -1);
+        ++count;
+    }
+    if (count == 0)
+        return 0;
+
+    // Close the gaps in a single sweep, keeping the survivors in slot order;
+    // slots before the first gap are not written, so their chunks stay shared
+    int out = 0;
+    for (int slot = 0; slot < size(); ++slot)
+    {
+        if (removed.at(slot))
+            continue;
+        if (out != slot)
+        {
+            slotIds.set(out, slotIds.at(slot));
+            kinds.set(out, kinds.at(slot));
+            minX.set(out, minX.at(slot));
+            minY.set(out, minY.at(slot));
+            maxX.set(out, maxX.at(slot));
+            maxY.set(out, maxY.at(slot));
+            slotById.set(int(slotIds.at(out)), out);
+        }
+        ++out;
+    }
+    slotIds.resize(out);
+    kinds.resize(out);
+    minX.resize(out);
+    minY.resize(out);
+    maxX.resize(out);
+    maxY.resize(out);
+
+    zOrderHoles += count;
+    if (zOrderHoles > 64 && zOrderHoles * 2 > zOrder.size())
+        compactZOrder();
+    return count;
+}
+
+int ShapeStore::restoreMany(const QVector<ShapeRecord> &records)
+{
+    ShapeId last = InvalidShapeId;
+    for (const ShapeRecord &record : records)
+    {
+        if (record.id <= MaxShapeId)
+            last = std::max(last, record.id);
+    }
+    reserveIds(last + 1);
+
+    // Ids still in the z-order as holes are revived in place; the others are
+    // merged in with one sort instead of an insertion each
+    QVector<ShapeId> missing;
+    int count = 0;
+    for (const ShapeRecord &record : records)
+    {
+        if (record.id == InvalidShapeId || record.id > MaxShapeId || contains(record.id))
+            continue;
+        const QRect &b = record.bounds;
+        appendSlot(record.id, record.kind, b.left(), b.top(), b.right(), b.bottom());
+        ++count;
+
+        if (std::binary_search(zOrder.begin(), zOrder.end(), record.id))
+            --zOrderHoles;
+        else
+            missing.append(record.id);
+    }
+
+    if (missing.isEmpty())
+        return count;
+
+    // Only the z-order from the first new id on is rewritten
+    std::sort(missing.begin(), missing.end());
+    const int from = int(std::lower_bound(zOrder.begin(), zOrder.end(), missing.first()) - zOrder.begin());
+    QVector<ShapeId> tail;
+    tail.reserve(zOrder.size() - from + missing.size());
+    for (int i = from; i < zOrder.size(); ++i)
+        tail.append(zOrder.at(i));
+    const int middle = tail.size();
+    tail += missing;
+    std::inplace_merge(tail.begin(), tail.begin() + middle, tail.end());
+
+    zOrder.resize(from);
+    for (ShapeId id : tail)
+        zOrder.append(id);
+    return count;
+}
+
+void ShapeStore::compactZOrder()
+{
+    int out = 0;
+    for (int i = 0; i < zOrder.size(); ++i)
+    {
+        const ShapeId id = zOrder.at(i);
+        if (slotById.at(int(id)) >= 0)
+            zOrder.set(out++, id);
+    }
+    zOrder.resize(out);
+    zOrderHoles = 0;
+}
+
+void ShapeStore::clear()
+{
+    slotIds.clear();
+    kinds.clear();
+    minX.clear();
+    minY.clear();
+    maxX.clear();
+    maxY.clear();
+    slotById.clear();
+    zOrder.clear();
+    zOrderHoles = 0;
+    nextId = 1;
+}
+
+void ShapeStore::reserve(int count)
+{
+    slotIds.reserve(count);
+    kinds.reserve(count);
+    minX.reserve(count);
+    minY.reserve(count);
+    maxX.reserve(count);
+    maxY.reserve(count);
+    slotById.reserve(int(nextId) + count);
+    zOrder.reserve(count);
+}
+
+QRect ShapeStore::extent() const
+{
+    QRect result;
+    for (int run = 0; run < runCount(); ++run)
+    {
+        const QRect bounds = GeometryKernels::unite(boxRun(run));
+        result = run == 0 ? bounds : result.united(bounds);
+    }
+    return result;
+}
+
+GeometryKernels::Boxes ShapeStore::boxRun(int run) const
+{
+    GeometryKernels::Boxes boxes;
+    boxes.minX = minX.chunkData(run);
+    boxes.minY = minY.chunkData(run);
+    boxes.maxX = maxX.chunkData(run);
+    boxes.maxY = maxY.chunkData(run);
+    boxes.count = minX.chunkLength(run);
+    return boxes;
+}
+
+int ShapeStore::slotOf(ShapeId id) const
+{
+    if (id == InvalidShapeId || int(id) >= slotById.size())
+        return -1;
+    return slotById.at(int(id));
+}
+
+QRect ShapeStore::boundsAt(int slot) const
+{
+    return QRect(QPoint(minX.at(slot), minY.at(slot)), QPoint(maxX.at(slot), maxY.at(slot)));
+}
+
+QPoint ShapeStore::centerAt(int slot) const
+{
+    return QPoint((minX.at(slot) + maxX.at(slot)) / 2, (minY.at(slot) + maxY.at(slot)) / 2);
+}
@@ -0,0 +1,144 @@
+#ifndef SHAPESTORE_H
+#define SHAPESTORE_H
+
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+
+#include <limits>
+
+#include "chunkedcolumn.h"
+#include "geometrykernels.h"
+
+using ShapeId = quint32;
+constexpr ShapeId InvalidShapeId = 0;
+// Ids index a table of slots, so they stay within int range
+constexpr ShapeId MaxShapeId = ShapeId(std::numeric_limits<int>::max() - 1);
+
+enum class ShapeKind : quint8
+{
+    Rectangle,
+    Circle
+};
+
+// A shape detached from the store: enough to put it back under its old id,
+// and with it at its old z position
+struct ShapeRecord
+{
+    ShapeId id = InvalidShapeId;
+    ShapeKind kind = ShapeKind::Rectangle;
+    QRect bounds;
+};
+
+// A shape to be added: its kind and bounding box, which for a circle is the
+// square around it
+struct ShapeSpec
+{
+    ShapeKind kind = ShapeKind::Rectangle;
+    QRect bounds;
+
+    static ShapeSpec rectangle(const QRect &rect) { return {ShapeKind::Rectangle, rect.normalized()}; }
+    static ShapeSpec circle(const QPoint &center, int radius)
+    {
+        return {ShapeKind::Circle, QRect(center - QPoint(radius, radius), center + QPoint(radius, radius))};
+    }
+};
+
+// Structure-of-arrays storage for all canvas shapes.
+//
+// Every shape occupies one slot in a set of packed columns (kind and integer
+// bounding box). Slots are dense and are reordered by remove(), which moves
+// the last slot into the hole; shapes are addressed by a stable ShapeId that
+// is mapped to its current slot. Ids are handed out in increasing order and
+// the id order is the z-order (bottom to top).
+//
+// Columns are chunked and copy-on-write per chunk, so a copy of the store is
+// a consistent snapshot that costs a pointer per chunk. A background save or
+// print can work from it while editing goes on; each edit then copies only
+// the few chunks it writes to, not the scene.
+class ShapeStore
+{
+public:
+    ShapeId addRectangle(const QRect &rect);
+    ShapeId addCircle(const QPoint &center, int radius);
+    // Adds count shapes under consecutive ids and returns the first
+    ShapeId addShapes(const ShapeSpec *shapes, int count);
+    bool remove(ShapeId id);
+    bool restore(const ShapeRecord &record);
+    // Batch forms of remove() and restore(): one pass over the columns and
+    // the z-order however many shapes are involved. Ids that do not apply
+    // are skipped; the result is the number of shapes removed or restored.
+    int removeMany(const QVector<ShapeId> &ids);
+    int restoreMany(const QVector<ShapeRecord> &records);
+    // Appends count shapes given as columns, bottom to top, above every
+    // shape in the store: ids ascending from nextShapeId() on and at most
+    // MaxShapeId. Columns are copied a chunk at a time. Returns false, with
+    // the store unchanged, if the ids do not qualify.
+    bool appendColumns(const ShapeId *ids, const ShapeKind *kindColumn, const qint32 *x0, const qint32 *y0,
+                       const qint32 *x1, const qint32 *y1, int count);
+    // Makes next the lowest id addRectangle() and friends may hand out.
+    // The id table grows to next entries, so callers reading ids from a
+    // file bound them first; ids past MaxShapeId are refused.
+    bool reserveIds(ShapeId next);
+    ShapeId nextShapeId() const { return nextId; }
+    void clear();
+    void reserve(int count);
+
+    int size() const { return slotIds.size(); }
+    bool isEmpty() const { return slotIds.isEmpty(); }
+    bool contains(ShapeId id) const { return slotOf(id) >= 0; }
+    int slotOf(ShapeId id) const;
+
+    ShapeId idAt(int slot) const { return slotIds.at(slot); }
+    ShapeKind kindAt(int slot) const { return kinds.at(slot); }
+    QRect boundsAt(int slot) const;
+    QRect rectAt(int slot) const { return boundsAt(slot); }
+    QPoint centerAt(int slot) const;
+    int radiusAt(int slot) const { return (maxX.at(slot) - minX.at(slot)) / 2; }
+    // Bounding box of every shape; empty for an empty store
+    QRect extent() const;
+    ShapeRecord recordAt(int slot) const { return {slotIds.at(slot), kinds.at(slot), boundsAt(slot)}; }
+
+    // Bounding-box columns, one entry per slot
+    qint32 minXAt(int slot) const { return minX.at(slot); }
+    qint32 minYAt(int slot) const { return minY.at(slot); }
+    qint32 maxXAt(int slot) const { return maxX.at(slot); }
+    qint32 maxYAt(int slot) const { return maxY.at(slot); }
+
+    // The same columns in contiguous runs for the batch kernels: run r holds
+    // slots [r * runLength, r * runLength + boxRun(r).count)
+    static constexpr int runLength = ChunkedColumn<qint32>::chunkSize;
+    int runCount() const { return minX.chunkCount(); }
+    GeometryKernels::Boxes boxRun(int run) const;
+
+    // Calls f(slot) for every shape from bottom to top
+    template<typename F>
+    void forEachInZOrder(F f) const
+    {
+        for (ShapeId id : zOrder)
+        {
+            const int slot = slotOf(id);
+            if (slot >= 0)
+                f(slot);
+        }
+    }
+
+private:
+    ShapeId append(ShapeKind kind, qint32 x0, qint32 y0, qint32 x1, qint32 y1);
+    void appendSlot(ShapeId id, ShapeKind kind, qint32 x0, qint32 y0, qint32 x1, qint32 y1);
+    void compactZOrder();
+
+    ChunkedColumn<ShapeId> slotIds;
+    ChunkedColumn<ShapeKind> kinds;
+    ChunkedColumn<qint32> minX;
+    ChunkedColumn<qint32> minY;
+    ChunkedColumn<qint32> maxX;
+    ChunkedColumn<qint32> maxY;
+
+    ChunkedColumn<int> slotById;   // indexed by id, -1 once removed
+    ChunkedColumn<ShapeId> zOrder; // ascending ids, may still hold removed ones
+    int zOrderHoles = 0;
+    ShapeId nextId = 1;
+};
+
+#endif // SHAPESTORE_H
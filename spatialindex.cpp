@@ -0,0 +1,185 @@
+#include "spatialindex.h"
+
+#include <algorithm>
+
+namespace {
+// An item goes to the finest grid where it covers at most this many cells
+constexpr qint64 maxCellsPerItem = 64;
+// Cell size ratio between neighbouring grids
+constexpr int levelFactor = 8;
+// Cells this large split the whole 32-bit plane into 8 x 8 cells, so every
+// item fits the grid that has them
+constexpr qint64 topCellSize = qint64(1) << 29;
+}
+
+SpatialIndex::SpatialIndex(int cellSize)
+{
+    for (qint64 size = std::max(1, cellSize);; size *= levelFactor)
+    {
+        Level level;
+        level.cellSize = int(std::min(size, topCellSize));
+        levels.append(level);
+        if (size >= topCellSize)
+            break;
+    }
+}
+
+void SpatialIndex::clear()
+{
+    for (Level &level : levels)
+    {
+        level.cells.clear();
+        level.items = 0;
+    }
+    itemCount = 0;
+}
+
+int SpatialIndex::Level::cellCoord(int v) const
+{
+    // Floor division so negative world coordinates land in the right cell
+    return v >= 0 ? v / cellSize : -((-v - 1) / cellSize) - 1;
+}
+
+quint64 SpatialIndex::cellKey(int cx, int cy)
+{
+    return (quint64(quint32(cx)) << 32) | quint32(cy);
+}
+
+int SpatialIndex::levelOf(const QRect &bounds) const
+{
+    for (int i = 0; i < levels.size() - 1; ++i)
+    {
+        const Level &level = levels.at(i);
+        const qint64 cols = qint64(level.cellCoord(bounds.right())) - level.cellCoord(bounds.left()) + 1;
+        const qint64 rows = qint64(level.cellCoord(bounds.bottom())) - level.cellCoord(bounds.top()) + 1;
+        if (cols * rows <= maxCellsPerItem)
+            return i;
+    }
+    return levels.size() - 1;
+}
+
+void SpatialIndex::insert(quint32 item, const QRect &bounds)
+{
+    ++itemCount;
+    Level &level = levels[levelOf(bounds)];
+    ++level.items;
+
+    const int x1 = level.cellCoord(bounds.right());
+    const int y1 = level.cellCoord(bounds.bottom());
+    for (int cy = level.cellCoord(bounds.top()); cy <= y1; ++cy)
+        for (int cx = level.cellCoord(bounds.left()); cx <= x1; ++cx)
+            level.cells[cellKey(cx, cy)].append({item, bounds});
+}
+
+void SpatialIndex::removeEntry(QVector<Entry> &entries, quint32 item)
+{
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        if (entries.at(i).item == item)
+        {
+            // Order inside a cell is irrelevant, queries sort their output
+            entries[i] = entries.last();
+            entries.removeLast();
+            return;
+        }
+    }
+}
+
+void SpatialIndex::remove(quint32 item, const QRect &bounds)
+{
+    --itemCount;
+    Level &level = levels[levelOf(bounds)];
+    --level.items;
+
+    const int x1 = level.cellCoord(bounds.right());
+    const int y1 = level.cellCoord(bounds.bottom());
+    for (int cy = level.cellCoord(bounds.top()); cy <= y1; ++cy)
+    {
+        for (int cx = level.cellCoord(bounds.left()); cx <= x1; ++cx)
+        {
+            auto it = level.cells.find(cellKey(cx, cy));
+            if (it == level.cells.end())
+                continue;
+            removeEntry(it.value(), item);
+            if (it.value().isEmpty())
+                level.cells.erase(it);
+        }
+    }
+}
+
+void SpatialIndex::queryLevel(const Level &level, const QRect &area, QVector<quint32> &result)
+{
+    const int x0 = level.cellCoord(area.left());
+    const int y0 = level.cellCoord(area.top());
+    const int x1 = level.cellCoord(area.right());
+    const int y1 = level.cellCoord(area.bottom());
+    const qint64 span = (qint64(x1) - x0 + 1) * (qint64(y1) - y0 + 1);
+
+    if (span > level.cells.size())
+    {
+        // Area covers more cells than are occupied: walk the occupied ones
+        for (auto it = level.cells.constBegin(); it != level.cells.constEnd(); ++it)
+        {
+            for (const Entry &e : it.value())
+            {
+                if (e.bounds.intersects(area))
+                    result.append(e.item);
+            }
+        }
+        return;
+    }
+
+    for (int cy = y0; cy <= y1; ++cy)
+    {
+        for (int cx = x0; cx <= x1; ++cx)
+        {
+            auto it = level.cells.constFind(cellKey(cx, cy));
+            if (it == level.cells.constEnd())
+                continue;
+            for (const Entry &e : it.value())
+            {
+                if (e.bounds.intersects(area))
+                    result.append(e.item);
+            }
+        }
+    }
+}
+
+void SpatialIndex::query(const QRect &area, QVector<quint32> &result) const
+{
+    result.clear();
+    if (area.isEmpty())
+        return;
+
+    for (const Level &level : levels)
+    {
+        if (level.items > 0)
+            queryLevel(level, area, result);
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+void SpatialIndex::queryPoint(const QPoint &point, QVector<quint32> &result) const
+{
+    result.clear();
+
+    // A point lies in exactly one cell per grid and an item in one grid, so
+    // no duplicates can show up
+    for (const Level &level : levels)
+    {
+        if (level.items == 0)
+            continue;
+        auto it = level.cells.constFind(cellKey(level.cellCoord(point.x()), level.cellCoord(point.y())));
+        if (it == level.cells.constEnd())
+            continue;
+        for (const Entry &e : it.value())
+        {
+            if (e.bounds.contains(point))
+                result.append(e.item);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+}
@@ -0,0 +1,54 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QHash>
+#include <QRect>
+#include <QVector>
+
+// Hierarchy of uniform grids over world coordinates, each with cells eight
+// times the size of the one below. An item goes to the finest grid on which
+// its bounds touch only a few cells and is registered in each of them, so
+// a wall or sheet frame costs a handful of cells on a coarse grid rather
+// than a scan of its own on every query. Queries visit the cells they touch
+// on each grid that holds items.
+class SpatialIndex
+{
+public:
+    explicit SpatialIndex(int cellSize = 32); // of the finest grid
+
+    void clear();
+    void insert(quint32 item, const QRect &bounds);
+    void remove(quint32 item, const QRect &bounds);
+
+    // Items whose bounds intersect area (resp. contain point), ascending and unique.
+    void query(const QRect &area, QVector<quint32> &result) const;
+    void queryPoint(const QPoint &point, QVector<quint32> &result) const;
+
+    int size() const { return itemCount; }
+
+private:
+    struct Entry
+    {
+        quint32 item;
+        QRect bounds;
+    };
+
+    struct Level
+    {
+        int cellSize = 1;
+        QHash<quint64, QVector<Entry>> cells;
+        int items = 0;
+
+        int cellCoord(int v) const;
+    };
+
+    static quint64 cellKey(int cx, int cy);
+    int levelOf(const QRect &bounds) const;
+    static void removeEntry(QVector<Entry> &entries, quint32 item);
+    static void queryLevel(const Level &level, const QRect &area, QVector<quint32> &result);
+
+    QVector<Level> levels;
+    int itemCount = 0;
+};
+
+#endif // SPATIALINDEX_H
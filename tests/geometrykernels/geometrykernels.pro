@@ -0,0 +1,20 @@
+# The batch geometry kernels in every instruction set the CPU has, against
+# the scalar reference: qmake && make check
+
+QT += testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = tst_geometrykernels
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_geometrykernels.cpp \
+    ../../geometrykernels.cpp
+
+HEADERS += \
+    ../../geometrykernels.h
@@ -0,0 +1,257 @@
+#include "geometrykernels.h"
+
+#include <QRandomGenerator>
+#include <QVector>
+#include <QtTest>
+
+#include <algorithm>
+
+using GeometryKernels::Isa;
+
+namespace {
+
+// Box columns as ShapeStore keeps them
+struct Columns
+{
+    QVector<qint32> minX;
+    QVector<qint32> minY;
+    QVector<qint32> maxX;
+    QVector<qint32> maxY;
+
+    void append(qint32 x0, qint32 y0, qint32 x1, qint32 y1)
+    {
+        minX.append(x0);
+        minY.append(y0);
+        maxX.append(x1);
+        maxY.append(y1);
+    }
+
+    GeometryKernels::Boxes boxes() const
+    {
+        GeometryKernels::Boxes b;
+        b.minX = minX.constData();
+        b.minY = minY.constData();
+        b.maxX = maxX.constData();
+        b.maxY = maxY.constData();
+        b.count = minX.size();
+        return b;
+    }
+};
+
+// count boxes scattered within spread of center, some with an edge through
+// center so that the inclusive comparisons are exercised
+Columns rectangles(int count, const QPoint &center, int spread)
+{
+    QRandomGenerator random(quint32(count) * 7919 + 1);
+    Columns columns;
+    for (int i = 0; i < count; ++i)
+    {
+        qint32 x0 = center.x() + random.bounded(-spread, spread);
+        qint32 y0 = center.y() + random.bounded(-spread, spread);
+        qint32 x1 = x0 + random.bounded(0, spread);
+        qint32 y1 = y0 + random.bounded(0, spread);
+        if (i % 5 == 1)
+        {
+            x0 = center.x();
+            x1 = std::max(x0, x1);
+        }
+        if (i % 5 == 2)
+        {
+            y1 = center.y();
+            y0 = std::min(y0, y1);
+        }
+        columns.append(x0, y0, x1, y1);
+    }
+    return columns;
+}
+
+// count circles by their bounding boxes: odd and even widths, so the center
+// and radius get rounded, and some with the outline passing through center
+Columns circles(int count, const QPoint &center, int spread)
+{
+    QRandomGenerator random(quint32(count) * 104729 + 3);
+    Columns columns;
+    for (int i = 0; i < count; ++i)
+    {
+        qint32 cx = center.x() + random.bounded(-spread, spread);
+        qint32 cy = center.y() + random.bounded(-spread, spread);
+        qint32 r = random.bounded(0, spread);
+        if (i % 4 == 1)
+        {
+            // 3-4-5: the point lies on the outline
+            cx = center.x() - 3;
+            cy = center.y() + 4;
+            r = 5;
+        }
+        const qint32 odd = i % 3 == 2 ? 1 : 0;
+        columns.append(cx - r, cy - r, cx + r + odd, cy + r + odd);
+    }
+    return columns;
+}
+
+QVector<int> run(int (*kernel)(const GeometryKernels::Boxes &, const QPoint &, int *), const Columns &columns,
+                 const QPoint &point)
+{
+    const GeometryKernels::Boxes boxes = columns.boxes();
+    QVector<int> found(boxes.count);
+    found.resize(kernel(boxes, point, found.data()));
+    return found;
+}
+
+QVector<int> runIntersecting(const Columns &columns, const QRect &area)
+{
+    const GeometryKernels::Boxes boxes = columns.boxes();
+    QVector<int> found(boxes.count);
+    found.resize(GeometryKernels::intersecting(boxes, area, found.data()));
+    return found;
+}
+
+} // namespace
+
+// Every instruction set this CPU has against the scalar reference, for
+// counts below, at and past the vector widths and coordinates up to the
+// 2^25 circleContains() is exact for
+class TestGeometryKernels : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+
+    void containing_data();
+    void containing();
+    void intersecting_data();
+    void intersecting();
+    void circlesContaining_data();
+    void circlesContaining();
+    void emptyInput();
+
+private:
+    void addCases();
+};
+
+void TestGeometryKernels::cleanup()
+{
+    GeometryKernels::setActiveIsa(GeometryKernels::bestIsa());
+}
+
+void TestGeometryKernels::addCases()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<QPoint>("point");
+    QTest::addColumn<int>("spread");
+
+    const int far = (1 << 25) - 64;
+    const QList<int> counts = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100};
+    for (int count : counts)
+    {
+        QTest::addRow("%d near origin", count) << count << QPoint(-2, 3) << 20;
+        QTest::addRow("%d near +2^25", count) << count << QPoint(far, far) << 30;
+        QTest::addRow("%d near -2^25", count) << count << QPoint(-far, -far) << 30;
+        QTest::addRow("%d near (+2^25, -2^25)", count) << count << QPoint(far, -far) << 30;
+    }
+}
+
+void TestGeometryKernels::containing_data()
+{
+    addCases();
+}
+
+void TestGeometryKernels::containing()
+{
+    QFETCH(int, count);
+    QFETCH(QPoint, point);
+    QFETCH(int, spread);
+
+    const Columns columns = rectangles(count, point, spread);
+    QVector<int> expected;
+    for (int i = 0; i < count; ++i)
+    {
+        if (QRect(QPoint(columns.minX[i], columns.minY[i]), QPoint(columns.maxX[i], columns.maxY[i])).contains(point))
+            expected.append(i);
+    }
+
+    for (int isa = int(Isa::Scalar); isa <= int(GeometryKernels::bestIsa()); ++isa)
+    {
+        GeometryKernels::setActiveIsa(Isa(isa));
+        QCOMPARE(GeometryKernels::activeIsa(), Isa(isa));
+        QCOMPARE(run(GeometryKernels::containing, columns, point), expected);
+    }
+}
+
+void TestGeometryKernels::intersecting_data()
+{
+    addCases();
+}
+
+void TestGeometryKernels::intersecting()
+{
+    QFETCH(int, count);
+    QFETCH(QPoint, point);
+    QFETCH(int, spread);
+
+    const Columns columns = rectangles(count, point, spread);
+    const QRect area(point - QPoint(spread / 4, spread / 3), QSize(spread / 2, spread / 4 + 1));
+    QVector<int> expected;
+    for (int i = 0; i < count; ++i)
+    {
+        if (QRect(QPoint(columns.minX[i], columns.minY[i]), QPoint(columns.maxX[i], columns.maxY[i])).intersects(area))
+            expected.append(i);
+    }
+
+    for (int isa = int(Isa::Scalar); isa <= int(GeometryKernels::bestIsa()); ++isa)
+    {
+        GeometryKernels::setActiveIsa(Isa(isa));
+        QCOMPARE(GeometryKernels::activeIsa(), Isa(isa));
+        QCOMPARE(runIntersecting(columns, area), expected);
+    }
+}
+
+void TestGeometryKernels::circlesContaining_data()
+{
+    addCases();
+}
+
+void TestGeometryKernels::circlesContaining()
+{
+    QFETCH(int, count);
+    QFETCH(QPoint, point);
+    QFETCH(int, spread);
+
+    const Columns columns = circles(count, point, spread);
+    QVector<int> expected;
+    for (int i = 0; i < count; ++i)
+    {
+        if (GeometryKernels::circleContains(columns.minX[i], columns.minY[i], columns.maxX[i], columns.maxY[i], point))
+            expected.append(i);
+    }
+    if (count > 1)
+        QVERIFY(expected.contains(1)); // the circle through point
+
+    for (int isa = int(Isa::Scalar); isa <= int(GeometryKernels::bestIsa()); ++isa)
+    {
+        GeometryKernels::setActiveIsa(Isa(isa));
+        QCOMPARE(GeometryKernels::activeIsa(), Isa(isa));
+        QCOMPARE(run(GeometryKernels::circlesContaining, columns, point), expected);
+    }
+}
+
+void TestGeometryKernels::emptyInput()
+{
+    // No columns at all, as an empty ShapeStore run hands out
+    const GeometryKernels::Boxes none;
+    int out = -1;
+    for (int isa = int(Isa::Scalar); isa <= int(GeometryKernels::bestIsa()); ++isa)
+    {
+        GeometryKernels::setActiveIsa(Isa(isa));
+        QCOMPARE(GeometryKernels::containing(none, QPoint(0, 0), &out), 0);
+        QCOMPARE(GeometryKernels::intersecting(none, QRect(-10, -10, 20, 20), &out), 0);
+        QCOMPARE(GeometryKernels::circlesContaining(none, QPoint(0, 0), &out), 0);
+        QCOMPARE(out, -1);
+        QVERIFY(GeometryKernels::unite(none).isEmpty());
+    }
+}
+
+QTEST_APPLESS_MAIN(TestGeometryKernels)
+
+#include "tst_geometrykernels.moc"
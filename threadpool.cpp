@@ -0,0 +1,147 @@
+#include "threadpool.h"
+
+#include <QThread>
+
+#include <algorithm>
+
+namespace {
+// Queue index of the pool worker running on this thread, -1 elsewhere
+thread_local int currentWorker = -1;
+thread_local const void *currentPool = nullptr;
+}
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+{
+    threadCount = std::max(1, threadCount);
+    for (int i = 0; i < threadCount; ++i)
+        queues.push_back(std::make_unique<Queue>());
+    for (int i = 0; i < threadCount; ++i)
+        threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+WorkStealingPool &WorkStealingPool::global()
+{
+    static WorkStealingPool pool;
+    return pool;
+}
+
+int WorkStealingPool::defaultThreadCount()
+{
+    // The thread calling run() works too, so leave it a core
+    return std::max(1, QThread::idealThreadCount() - 1);
+}
+
+void WorkStealingPool::run(const QVector<std::function<void()>> &tasks)
+{
+    if (tasks.isEmpty())
+        return;
+    if (tasks.size() == 1)
+    {
+        tasks.first()();
+        return;
+    }
+
+    Batch batch;
+    batch.remaining = int(tasks.size());
+
+    // Callers inside the pool fill their own deque first so idle workers steal
+    // the rest; outside callers spread the batch round-robin
+    const int self = currentPool == this ? currentWorker : -1;
+    const int n = int(queues.size());
+    for (int i = 0; i < tasks.size(); ++i)
+    {
+        const int q = self >= 0 ? self : int(nextQueue++ % unsigned(n));
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        queues[q]->tasks.push_back({tasks.at(i), &batch});
+    }
+    queuedTasks += int(tasks.size());
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+
+    while (batch.remaining.load() > 0)
+    {
+        if (runOne(self))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return batch.remaining.load() == 0 || queuedTasks.load() > 0; });
+    }
+}
+
+void WorkStealingPool::workerLoop(int index)
+{
+    currentWorker = index;
+    currentPool = this;
+    for (;;)
+    {
+        if (runOne(index))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return stopping || queuedTasks.load() > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+bool WorkStealingPool::popOwn(int self, Task &task)
+{
+    Queue &queue = *queues[self];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+        return false;
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(int self, Task &task)
+{
+    const int n = int(queues.size());
+    const int start = self >= 0 ? self + 1 : int(nextQueue.load() % unsigned(n));
+    for (int i = 0; i < n; ++i)
+    {
+        const int victim = (start + i) % n;
+        if (victim == self)
+            continue;
+        Queue &queue = *queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+bool WorkStealingPool::runOne(int self)
+{
+    if (queuedTasks.load() == 0)
+        return false;
+
+    Task task;
+    if (!(self >= 0 && popOwn(self, task)) && !steal(self, task))
+        return false;
+    --queuedTasks;
+
+    task.function();
+    if (--task.batch->remaining == 0)
+    {
+        // Wake the thread waiting in run() for this batch
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_all();
+    }
+    return true;
+}
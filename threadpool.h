@@ -0,0 +1,69 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <QVector>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool with one deque per worker. Workers pop their own queue from
+// the back and steal from the front of the others when they run dry, so
+// uneven tiles (one dense, many empty) still keep every core busy.
+//
+// run() blocks until its batch is done, but the calling thread executes
+// queued tasks while it waits; nested run() calls from inside a task are
+// therefore safe and do not starve the pool.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(int threadCount = defaultThreadCount());
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    static WorkStealingPool &global();
+    static int defaultThreadCount();
+
+    void run(const QVector<std::function<void()>> &tasks);
+    int threadCount() const { return int(threads.size()); }
+
+private:
+    struct Batch
+    {
+        std::atomic<int> remaining{0};
+    };
+
+    struct Task
+    {
+        std::function<void()> function;
+        Batch *batch;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(int index);
+    bool runOne(int self);
+    bool popOwn(int self, Task &task);
+    bool steal(int self, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> queuedTasks{0};
+    std::atomic<unsigned> nextQueue{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif // THREADPOOL_H
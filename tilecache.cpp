@@ -0,0 +1,74 @@
+#include "tilecache.h"
+
+#include <QtMath>
+
+TileCache::TileCache(qsizetype maxBytes)
+    : tiles(maxBytes)
+{
+}
+
+quint64 TileCache::key(const QPoint &tile)
+{
+    return (quint64(quint32(tile.x())) << 32) | quint32(tile.y());
+}
+
+const QImage *TileCache::find(const QPoint &tile) const
+{
+    return tiles.object(key(tile));
+}
+
+void TileCache::insert(const QPoint &tile, const QImage &image)
+{
+    tiles.insert(key(tile), new QImage(image), image.sizeInBytes());
+}
+
+void TileCache::invalidate(const QRect &world)
+{
+    for (const QPoint &tile : tilesCovering(QRectF(world)))
+        tiles.remove(key(tile));
+}
+
+void TileCache::clear()
+{
+    tiles.clear();
+}
+
+void TileCache::setDevicePixelRatio(qreal ratio)
+{
+    if (ratio == dpr)
+        return;
+    dpr = ratio;
+    tiles.clear();
+}
+
+void TileCache::setScale(qreal scale)
+{
+    if (scale == worldScale)
+        return;
+    worldScale = scale;
+    tiles.clear();
+}
+
+QRectF TileCache::tileRect(const QPoint &tile) const
+{
+    const qreal side = tileSize / worldScale;
+    return QRectF(tile.x() * side, tile.y() * side, side, side);
+}
+
+QVector<QPoint> TileCache::tilesCovering(const QRectF &world) const
+{
+    QVector<QPoint> result;
+    if (world.isEmpty())
+        return result;
+
+    const qreal perTile = worldScale / tileSize;
+    const int x0 = qFloor(world.left() * perTile);
+    const int x1 = qCeil(world.right() * perTile) - 1;
+    const int y0 = qFloor(world.top() * perTile);
+    const int y1 = qCeil(world.bottom() * perTile) - 1;
+    result.reserve((x1 - x0 + 1) * (y1 - y0 + 1));
+    for (int ty = y0; ty <= y1; ++ty)
+        for (int tx = x0; tx <= x1; ++tx)
+            result.append(QPoint(tx, ty));
+    return result;
+}
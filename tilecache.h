@@ -0,0 +1,49 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QRectF>
+#include <QVector>
+
+// Rasterized static geometry in tiles of tileSize view pixels, laid out on a
+// grid anchored at the world origin. Tiles are addressed by their integer
+// grid coordinate and evicted least-recently-used once the byte budget is
+// exceeded; edits invalidate only the tiles they touch. Panning keeps every
+// tile valid; a new scale (zoom) or device pixel ratio drops them all.
+class TileCache
+{
+public:
+    static constexpr int tileSize = 256;
+
+    explicit TileCache(qsizetype maxBytes = 256 * 1024 * 1024);
+
+    const QImage *find(const QPoint &tile) const;
+    void insert(const QPoint &tile, const QImage &image);
+    void invalidate(const QRect &world);
+    void clear();
+
+    // Device pixel ratio the cached tiles were rendered for
+    qreal devicePixelRatio() const { return dpr; }
+    void setDevicePixelRatio(qreal ratio);
+
+    // View pixels per world unit the cached tiles were rendered for
+    qreal scale() const { return worldScale; }
+    void setScale(qreal scale);
+
+    // World area of a tile; world y grows upwards, so a tile's image shows
+    // the rect's bottom() edge at its top row
+    QRectF tileRect(const QPoint &tile) const;
+    QVector<QPoint> tilesCovering(const QRectF &world) const;
+
+private:
+    static quint64 key(const QPoint &tile);
+
+    QCache<quint64, QImage> tiles;
+    qreal dpr = 1.0;
+    qreal worldScale = 1.0;
+};
+
+#endif // TILECACHE_H
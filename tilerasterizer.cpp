@@ -0,0 +1,43 @@
+#include "tilerasterizer.h"
+#include "threadpool.h"
+
+#include <QPainter>
+
+namespace TileRasterizer {
+
+QVector<QImage> render(const QVector<QSize> &pixelSizes, qreal devicePixelRatio,
+                       const PaintFunction &paint, const QColor &fill)
+{
+    QVector<QImage> images(pixelSizes.size());
+    QImage *results = images.data(); // detach once, before any worker runs
+    QVector<std::function<void()>> tasks;
+    tasks.reserve(pixelSizes.size());
+    for (int i = 0; i < pixelSizes.size(); ++i)
+    {
+        tasks.append([&, results, i] {
+            // Each worker writes only its own slot, so no locking is needed
+            QImage image(pixelSizes.at(i), QImage::Format_ARGB32_Premultiplied);
+            image.setDevicePixelRatio(devicePixelRatio);
+            image.fill(fill);
+            QPainter painter(&image);
+            paint(i, painter);
+            painter.end();
+            results[i] = image;
+        });
+    }
+    WorkStealingPool::global().run(tasks);
+    return images;
+}
+
+QVector<QRect> split(const QRect &area, int tileSize)
+{
+    QVector<QRect> tiles;
+    for (int y = area.top(); y <= area.bottom(); y += tileSize)
+    {
+        for (int x = area.left(); x <= area.right(); x += tileSize)
+            tiles.append(QRect(x, y, tileSize, tileSize).intersected(area));
+    }
+    return tiles;
+}
+
+} // namespace TileRasterizer
@@ -0,0 +1,29 @@
+#ifndef TILERASTERIZER_H
+#define TILERASTERIZER_H
+
+#include <QColor>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+#include <functional>
+
+class QPainter;
+
+namespace TileRasterizer {
+
+// Called once per tile on a pool thread with a painter already open on that
+// tile's image. It must only read shared state.
+using PaintFunction = std::function<void(int tile, QPainter &painter)>;
+
+// Renders one image per entry in pixelSizes in parallel on the global
+// work-stealing pool, each with its own QPainter, and returns them in order.
+QVector<QImage> render(const QVector<QSize> &pixelSizes, qreal devicePixelRatio,
+                       const PaintFunction &paint, const QColor &fill = Qt::transparent);
+
+// Cuts area into tileSize squares, clipping the last row and column.
+QVector<QRect> split(const QRect &area, int tileSize);
+
+} // namespace TileRasterizer
+
+#endif // TILERASTERIZER_H
@@ -0,0 +1,61 @@
+# Everything but the window and main(): the application and the
+# benchmarks build from these sources.
+
+QT       += core gui printsupport concurrent
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++17
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+# Profiling probes cost one flag check each while switched off; this line
+# removes them from the build altogether.
+#DEFINES += VIBECAD_PROFILING=0
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/canvas.cpp \
+    $$PWD/asyncsceneio.cpp \
+    $$PWD/batchrenderer.cpp \
+    $$PWD/csvimporter.cpp \
+    $$PWD/geometrykernels.cpp \
+    $$PWD/geometryquery.cpp \
+    $$PWD/pagepipeline.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/sceneio.cpp \
+    $$PWD/scenegenerator.cpp \
+    $$PWD/scenejournal.cpp \
+    $$PWD/scenerenderer.cpp \
+    $$PWD/shapeeditcommand.cpp \
+    $$PWD/shapeselection.cpp \
+    $$PWD/shapestore.cpp \
+    $$PWD/spatialindex.cpp \
+    $$PWD/threadpool.cpp \
+    $$PWD/tilecache.cpp \
+    $$PWD/tilerasterizer.cpp
+
+HEADERS += \
+    $$PWD/canvas.h \
+    $$PWD/asyncsceneio.h \
+    $$PWD/batchrenderer.h \
+    $$PWD/chunkedcolumn.h \
+    $$PWD/csvimporter.h \
+    $$PWD/geometrykernels.h \
+    $$PWD/geometryquery.h \
+    $$PWD/pagepipeline.h \
+    $$PWD/profiler.h \
+    $$PWD/sceneio.h \
+    $$PWD/scenegenerator.h \
+    $$PWD/scenejournal.h \
+    $$PWD/scenerenderer.h \
+    $$PWD/shapeeditcommand.h \
+    $$PWD/shapeselection.h \
+    $$PWD/shapestore.h \
+    $$PWD/spatialindex.h \
+    $$PWD/threadpool.h \
+    $$PWD/tilecache.h \
+    $$PWD/tilerasterizer.h